@@ -0,0 +1,364 @@
+
+#include "fs.h"
+
+// The block cache.  Disk block n lives at diskaddr(n), and is read in
+// from disk the first time that page is touched.  The processor sets
+// PTE_D when the server writes to a cached block, so flushing a block
+// writes it out only if it was modified since it was read or last
+// flushed; clean blocks never cost any disk I/O.
+//
+// Read-ahead brings in a run of blocks with one disk command while the
+// server goes on serving requests: the run is read into pages at
+// RAMAP, out of sight of the cache, and only mapped at diskaddr once
+// the transfer completes.  The disk takes one command at a time, so a
+// read-ahead asked for while another is in flight is queued rather
+// than waited for, and started by bc_readahead_poll once the disk is
+// free; the server polls after every request.  A fault on a block
+// still in flight, or on any block while the disk is busy, has to wait.
+// Flushes likewise write runs of adjacent dirty blocks with one
+// command each.
+
+// Staging area for the read-ahead in flight.
+#define RAMAP		0x0F000000
+
+static uint32_t ra_blockno;	// first block of the read-ahead in flight
+static uint32_t ra_nblocks;	// length of it, 0 if none
+static uint32_t raq_blockno;	// first block of the queued read-ahead
+static uint32_t raq_nblocks;	// length of it, 0 if none
+
+struct BcStats bc_stats;
+
+// Return the virtual address of this disk block.
+void*
+diskaddr(uint32_t blockno)
+{
+	if (blockno == 0 || (super && blockno >= super->s_nblocks))
+		panic("bad block number %08x in diskaddr", blockno);
+	return (char*) (DISKMAP + blockno * BLKSIZE);
+}
+
+// Is this virtual address mapped?
+bool
+va_is_mapped(void *va)
+{
+	return (uvpd[PDX(va)] & PTE_P) && (uvpt[PGNUM(va)] & PTE_P);
+}
+
+// Is this virtual address dirty?
+bool
+va_is_dirty(void *va)
+{
+	return (uvpt[PGNUM(va)] & PTE_D) != 0;
+}
+
+// Is block 'blockno' cached or on its way into the cache?
+bool
+bc_is_cached(uint32_t blockno)
+{
+	return va_is_mapped(diskaddr(blockno))
+		|| (blockno >= ra_blockno && blockno < ra_blockno + ra_nblocks)
+		|| (blockno >= raq_blockno && blockno < raq_blockno + raq_nblocks);
+}
+
+// Move the blocks of the completed read-ahead from the staging area
+// into the cache.  A block that was cached in the meantime (for
+// example, freed and reallocated by bc_zero_block) keeps its page.
+static void
+bc_readahead_done(void)
+{
+	void *addr;
+	uint32_t i;
+	int r;
+
+	for (i = 0; i < ra_nblocks; i++) {
+		addr = diskaddr(ra_blockno + i);
+		if (!va_is_mapped(addr)
+		    && (r = sys_page_map(0, (void *) (RAMAP + i * BLKSIZE),
+					 0, addr, PTE_P | PTE_U | PTE_W)) < 0)
+			panic("in bc_readahead_done, sys_page_map: %e", r);
+		sys_page_unmap(0, (void *) (RAMAP + i * BLKSIZE));
+	}
+	ra_nblocks = 0;
+}
+
+// Wait for the read-ahead in flight, if any, and cache its blocks.
+// Must be called before issuing any other disk command.
+static void
+bc_disk_wait(void)
+{
+	int r;
+
+	if (ra_nblocks == 0)
+		return;
+	if ((r = ide_read_wait()) < 0)
+		panic("in bc_disk_wait, ide_read_wait: %e", r);
+	bc_readahead_done();
+}
+
+// Start the queued read-ahead.  The disk must be free.
+static void
+bc_readahead_start(void)
+{
+	uint32_t i;
+	int r;
+
+	assert(ra_nblocks == 0);
+	for (i = 0; i < raq_nblocks; i++)
+		if ((r = sys_page_alloc(0, (void *) (RAMAP + i * BLKSIZE),
+					PTE_P | PTE_U | PTE_W)) < 0)
+			panic("in bc_readahead_start, sys_page_alloc: %e", r);
+
+	ra_blockno = raq_blockno;
+	ra_nblocks = raq_nblocks;
+	raq_nblocks = 0;
+	bc_stats.ra_cmds++;
+	bc_stats.ra_blocks += ra_nblocks;
+	if ((r = ide_read_async(ra_blockno * BLKSECTS, (void *) RAMAP,
+				ra_nblocks * BLKSECTS)) < 0)
+		panic("in bc_readahead_start, ide_read_async: %e", r);
+	if (r == 0)
+		bc_readahead_done();
+}
+
+// Without sleeping: cache the blocks of the read-ahead in flight if it
+// has finished, and start the queued one if the disk is free.
+void
+bc_readahead_poll(void)
+{
+	if (ra_nblocks && ide_read_done())
+		bc_disk_wait();
+	if (ra_nblocks == 0 && raq_nblocks)
+		bc_readahead_start();
+}
+
+// Wait until every read-ahead asked for, in flight or queued, is in
+// the cache.
+void
+bc_readahead_wait(void)
+{
+	bc_disk_wait();
+	if (raq_nblocks) {
+		bc_readahead_start();
+		bc_disk_wait();
+	}
+}
+
+// Read the n disk blocks beginning at 'blockno' into the cache in the
+// background, starting now if the disk is free and otherwise once it
+// is.  This replaces any read-ahead queued earlier.  The caller should
+// have checked that the blocks are allocated and not already cached.
+void
+bc_readahead(uint32_t blockno, uint32_t n)
+{
+	raq_blockno = blockno;
+	raq_nblocks = MIN(n, BC_MAXRUN);
+	bc_readahead_poll();
+}
+
+// Fault any disk block that is read in to memory by
+// loading it from disk.
+static void
+bc_pgfault(struct UTrapframe *utf)
+{
+	void *addr = (void *) utf->utf_fault_va;
+	uint32_t blockno = ((uint32_t)addr - DISKMAP) / BLKSIZE;
+	int r;
+
+	// Check that the fault was within the block cache region
+	if (addr < (void*)DISKMAP || addr >= (void*)(DISKMAP + DISKSIZE))
+		panic("page fault in FS: eip %08x, va %08x, err %04x",
+		      utf->utf_eip, addr, utf->utf_err);
+
+	// Sanity check the block number.
+	if (super && blockno >= super->s_nblocks)
+		panic("reading non-existent block %08x\n", blockno);
+
+	// The block may be part of the read-ahead in flight; either way
+	// that has to finish before the disk takes another command.  If it
+	// is part of the queued read-ahead, start that now and wait for it.
+	addr = ROUNDDOWN(addr, BLKSIZE);
+	bc_disk_wait();
+	if (blockno >= raq_blockno && blockno < raq_blockno + raq_nblocks) {
+		bc_readahead_start();
+		bc_disk_wait();
+	}
+	if (va_is_mapped(addr))
+		return;
+	bc_stats.misses++;
+
+	// Allocate a page in the disk map region, read the contents
+	// of the block from the disk into that page.
+	if ((r = sys_page_alloc(0, addr, PTE_P | PTE_U | PTE_W)) < 0)
+		panic("in bc_pgfault, sys_page_alloc: %e", r);
+	if ((r = ide_read(blockno * BLKSECTS, addr, BLKSECTS)) < 0)
+		panic("in bc_pgfault, ide_read: %e", r);
+
+	// Clear the dirty bit for the disk block page since we just read the
+	// block from disk
+	if ((r = sys_page_map(0, addr, 0, addr, uvpt[PGNUM(addr)] & PTE_SYSCALL)) < 0)
+		panic("in bc_pgfault, sys_page_map: %e", r);
+
+	// Check that the block we read was allocated. (exercise for
+	// the reader: why do we do this *after* reading the block
+	// in?)
+	if (bitmap && block_is_free(blockno))
+		panic("reading free block %08x\n", blockno);
+}
+
+// Flush the contents of the block containing VA out to disk if
+// necessary, then clear the PTE_D bit using sys_page_map.
+// If the block is not in the block cache or is not dirty, does
+// nothing.
+void
+flush_block(void *addr)
+{
+	uint32_t blockno = ((uint32_t)addr - DISKMAP) / BLKSIZE;
+
+	if (addr < (void*)DISKMAP || addr >= (void*)(DISKMAP + DISKSIZE))
+		panic("flush_block of bad va %08x", addr);
+
+	flush_blocks(blockno, 1);
+}
+
+// Flush the dirty blocks among the n blocks starting at 'blockno',
+// writing each run of adjacent dirty blocks with a single disk
+// command, and clear their PTE_D bits.  Blocks in the journal's
+// running transaction are left alone: their changes are not committed
+// yet, and must reach the disk through the journal.
+void
+flush_blocks(uint32_t blockno, uint32_t n)
+{
+	uint32_t end, len, i;
+	void *addr;
+	int r;
+
+	for (end = blockno + n; blockno < end; blockno += len) {
+		for (len = 0; blockno + len < end && len < BC_MAXRUN; len++) {
+			addr = diskaddr(blockno + len);
+			if (!va_is_mapped(addr) || !va_is_dirty(addr)
+			    || journal_holds(blockno + len))
+				break;
+		}
+		if (len == 0) {
+			len = 1;
+			continue;
+		}
+
+		bc_disk_wait();
+		if ((r = ide_write(blockno * BLKSECTS, diskaddr(blockno),
+				   len * BLKSECTS)) < 0)
+			panic("in flush_blocks, ide_write: %e", r);
+		for (i = 0; i < len; i++)
+			bc_clean(blockno + i);
+	}
+}
+
+// Clear the dirty bit of a cached block without writing it, for
+// blocks whose contents have reached the disk some other way.
+void
+bc_clean(uint32_t blockno)
+{
+	void *addr = diskaddr(blockno);
+	int r;
+
+	// Remapping the page with the permissions it already has clears
+	// PTE_D, which is not among PTE_SYSCALL.
+	if (va_is_mapped(addr) && va_is_dirty(addr)
+	    && (r = sys_page_map(0, addr, 0, addr,
+				 uvpt[PGNUM(addr)] & PTE_SYSCALL)) < 0)
+		panic("in bc_clean, sys_page_map: %e", r);
+}
+
+// Write the n blocks at 'src' to disk starting at block 'blockno',
+// bypassing the cache, whose copies of those blocks are left as they
+// are.
+void
+bc_write_run(uint32_t blockno, const void *src, uint32_t n)
+{
+	uint32_t i;
+	int r;
+
+	assert(n <= BC_MAXRUN);
+	// Fault the source in now; a fault in the middle of a PIO
+	// transfer would issue a read while the write is under way.
+	for (i = 0; i < n; i++)
+		(void) *((volatile const char *) src + i * BLKSIZE);
+	bc_disk_wait();
+	if ((r = ide_write(blockno * BLKSECTS, src, n * BLKSECTS)) < 0)
+		panic("in bc_write_run, ide_write: %e", r);
+}
+
+// Give a newly allocated block a zero-filled page in the cache without
+// reading its stale contents from disk.  The page is marked dirty so
+// the zeroes reach the disk the next time the block is flushed.
+void
+bc_zero_block(uint32_t blockno)
+{
+	void *addr = diskaddr(blockno);
+	int r;
+
+	if ((r = sys_page_alloc(0, addr, PTE_P | PTE_U | PTE_W)) < 0)
+		panic("in bc_zero_block, sys_page_alloc: %e", r);
+	*(volatile char *) addr = 0;
+}
+
+// Unmap every clean cached data block, so the next access to each one
+// reads it from disk.  The super block and bitmap stay cached:
+// bc_pgfault itself depends on them.  Callers should flush dirty blocks
+// first.  The journal is checkpointed first, since committed blocks are
+// clean in the cache before they are written home.
+void
+bc_drop(void)
+{
+	uint32_t blockno;
+
+	journal_checkpoint();
+	bc_readahead_wait();
+	for (blockno = 2 + (super->s_nblocks + BLKBITSIZE - 1) / BLKBITSIZE;
+	     blockno < super->s_nblocks; blockno++)
+		if (va_is_mapped(diskaddr(blockno)) && !va_is_dirty(diskaddr(blockno)))
+			sys_page_unmap(0, diskaddr(blockno));
+}
+
+// Test that the block cache works, by smashing the superblock and
+// reading it back.
+static void
+check_bc(void)
+{
+	struct Super backup;
+
+	// back up super block
+	memmove(&backup, diskaddr(1), sizeof backup);
+
+	// smash it
+	strcpy(diskaddr(1), "OOPS!\n");
+	flush_block(diskaddr(1));
+	assert(va_is_mapped(diskaddr(1)));
+	assert(!va_is_dirty(diskaddr(1)));
+
+	// clear it out
+	sys_page_unmap(0, diskaddr(1));
+	assert(!va_is_mapped(diskaddr(1)));
+
+	// read it back in
+	assert(strcmp(diskaddr(1), "OOPS!\n") == 0);
+
+	// fix it
+	memmove(diskaddr(1), &backup, sizeof backup);
+	flush_block(diskaddr(1));
+
+	cprintf("block cache is good\n");
+}
+
+void
+bc_init(void)
+{
+	struct Super super;
+
+	set_pgfault_handler(bc_pgfault);
+	check_bc();
+
+	// cache the super block by reading it once
+	memmove(&super, diskaddr(1), sizeof super);
+}
+
@@ -0,0 +1,959 @@
+#include <inc/string.h>
+#include <inc/crc.h>
+
+#include "fs.h"
+
+struct Super *super;		// superblock
+uint32_t *bitmap;		// bitmap blocks mapped in memory
+
+// --------------------------------------------------------------
+// Super block
+// --------------------------------------------------------------
+
+// Validate the file system super-block.
+void
+check_super(void)
+{
+	if (super->s_magic != FS_MAGIC)
+		panic("bad file system magic number");
+
+	if (super->s_nblocks > DISKSIZE/BLKSIZE)
+		panic("file system is too large");
+
+	cprintf("superblock is good\n");
+}
+
+// --------------------------------------------------------------
+// Free block bitmap
+// --------------------------------------------------------------
+
+// Check to see if the block bitmap indicates that block 'blockno' is free.
+// Return 1 if the block is free, 0 if not.
+bool
+block_is_free(uint32_t blockno)
+{
+	if (super == 0 || blockno >= super->s_nblocks)
+		return 0;
+	if (bitmap[blockno / 32] & (1 << (blockno % 32)))
+		return 1;
+	return 0;
+}
+
+// Mark a block free in the bitmap
+void
+free_block(uint32_t blockno)
+{
+	// Blockno zero is the null pointer of block numbers.
+	if (blockno == 0)
+		panic("attempt to free zero block");
+	bitmap[blockno/32] |= 1<<(blockno%32);
+	journal_write(&bitmap[blockno/32]);
+}
+
+// Where the next search for a free block starts when the caller has no
+// better goal.  It moves past each allocation, so successive searches
+// resume where the last one stopped instead of rescanning the full
+// prefix of the disk from block 0.
+static uint32_t alloc_hint;
+
+// Return the first free block at or after 'start', wrapping around to
+// the beginning of the disk, or -E_NO_DISK if every block is in use.
+// The bitmap is scanned a 32-bit word at a time; a set bit means free,
+// so the lowest set bit of the first nonzero word is the answer.
+static int
+bitmap_find_free(uint32_t start)
+{
+	uint32_t nwords, w, word, blockno, i;
+
+	nwords = (super->s_nblocks + 31) / 32;
+	if (start >= super->s_nblocks)
+		start = 0;
+	w = start / 32;
+	word = bitmap[w] & (~0U << (start % 32));
+	// nwords + 1 passes so the bits of the first word below 'start'
+	// are looked at after wrapping.
+	for (i = 0; i <= nwords; i++) {
+		if (word) {
+			blockno = w * 32 + __builtin_ctz(word);
+			// Bits past s_nblocks in the last word are not blocks.
+			if (blockno < super->s_nblocks)
+				return blockno;
+		}
+		w = (w + 1) % nwords;
+		word = bitmap[w];
+	}
+	return -E_NO_DISK;
+}
+
+// Allocate up to 'want' contiguous blocks, starting at the first free
+// block at or after 'goal'.  Sets *nalloc to the number allocated,
+// which is at least 1.  The changed bitmap blocks are journaled once
+// for the whole run.
+//
+// Returns the first block number of the run on success,
+// -E_NO_DISK if we are out of blocks.
+int
+alloc_run(uint32_t goal, uint32_t want, uint32_t *nalloc)
+{
+	uint32_t first, n, b;
+	int r;
+
+	assert(want > 0);
+	if ((r = bitmap_find_free(goal)) < 0)
+		return r;
+	first = r;
+
+	// Extend the run while the following blocks are free, a whole
+	// word at a time once the run reaches a word boundary.
+	for (n = 1; n < want && first + n < super->s_nblocks; ) {
+		b = first + n;
+		if (b % 32 == 0 && want - n >= 32 && b + 32 <= super->s_nblocks
+		    && bitmap[b / 32] == ~0U)
+			n += 32;
+		else if (block_is_free(b))
+			n++;
+		else
+			break;
+	}
+
+	for (b = first; b < first + n; ) {
+		if (b % 32 == 0 && first + n - b >= 32) {
+			bitmap[b / 32] = 0;
+			b += 32;
+		} else {
+			bitmap[b / 32] &= ~(1 << (b % 32));
+			b++;
+		}
+	}
+	journal_write(&bitmap[first / 32]);
+	journal_write(&bitmap[(first + n - 1) / 32]);
+	journal_reuse(first, n);
+
+	alloc_hint = first + n;
+	*nalloc = n;
+	return first;
+}
+
+// Search the bitmap for a free block and allocate it.  The changed
+// bitmap block is added to the journal's running transaction.
+//
+// Return block number allocated on success,
+// -E_NO_DISK if we are out of blocks.
+int
+alloc_block(void)
+{
+	uint32_t n;
+
+	return alloc_run(alloc_hint, 1, &n);
+}
+
+// Validate the file system bitmap.
+//
+// Check that all reserved blocks -- 0, 1, and the bitmap blocks themselves --
+// are all marked as in-use.
+void
+check_bitmap(void)
+{
+	uint32_t i;
+
+	// Make sure all bitmap blocks are marked in-use
+	for (i = 0; i * BLKBITSIZE < super->s_nblocks; i++)
+		assert(!block_is_free(2+i));
+
+	// Make sure the reserved and root blocks are marked in-use.
+	assert(!block_is_free(0));
+	assert(!block_is_free(1));
+
+	// Make sure the journal is marked in-use.
+	for (i = 0; i < super->s_jblocks; i++)
+		assert(!block_is_free(super->s_journal + i));
+
+	cprintf("bitmap is good\n");
+}
+
+// --------------------------------------------------------------
+// File system structures
+// --------------------------------------------------------------
+
+
+
+// Initialize the file system
+void
+fs_init(void)
+{
+	static_assert(sizeof(struct File) == 256);
+
+	// Find a JOS disk.  Use the second IDE disk (number 1) if available
+	if (ide_probe_disk1())
+		ide_set_disk(1);
+	else
+		ide_set_disk(0);
+	ide_init();
+	bc_init();
+
+	// Set "super" to point to the super block.
+	super = diskaddr(1);
+	check_super();
+
+	// Set "bitmap" to the beginning of the first bitmap block.
+	bitmap = diskaddr(2);
+
+	// Bring the metadata up to date before looking at it.
+	journal_init();
+	check_bitmap();
+}
+
+// Find the disk block number slot for the 'filebno'th block in file 'f'.
+// Set '*ppdiskbno' to point to that slot.
+// The slot will be one of the f->f_direct[] entries,
+// or an entry in the indirect block.
+// When 'alloc' is set, this function will allocate an indirect block
+// if necessary.
+//
+// Returns:
+//	0 on success (but note that *ppdiskbno might equal 0).
+//	-E_NOT_FOUND if the function needed to allocate an indirect block, but
+//		alloc was 0.
+//	-E_NO_DISK if there's no space on the disk for an indirect block.
+//	-E_INVAL if filebno is out of range (it's >= NDIRECT + NINDIRECT).
+static int
+file_block_walk(struct File *f, uint32_t filebno, uint32_t **ppdiskbno, bool alloc)
+{
+	int r;
+
+	if (filebno >= NDIRECT + NINDIRECT)
+		return -E_INVAL;
+	if (filebno < NDIRECT) {
+		*ppdiskbno = &f->f_direct[filebno];
+		return 0;
+	}
+	if (!f->f_indirect) {
+		if (!alloc)
+			return -E_NOT_FOUND;
+		if ((r = alloc_block()) < 0)
+			return r;
+		f->f_indirect = r;
+		bc_zero_block(r);
+		journal_write(diskaddr(r));
+		journal_write(f);
+	}
+	*ppdiskbno = (uint32_t *) diskaddr(f->f_indirect) + filebno - NDIRECT;
+	return 0;
+}
+
+// Make sure blocks [filebno, filebno + n) of file 'f' are allocated.
+// Each run of missing blocks is allocated as one extent, placed right
+// after the file block that precedes it when that disk block is free,
+// so a file that grows sequentially stays contiguous on disk.
+// New blocks are zero-filled in the block cache without reading them.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_NO_DISK if the disk filled up.  Blocks allocated before that
+//		stay allocated to the file.
+//	-E_INVAL if a block number is out of range.
+static int
+file_alloc_blocks(struct File *f, uint32_t filebno, uint32_t n)
+{
+	uint32_t *pdiskbno, *prev, bno, end, want, got, goal, first, i;
+	int r;
+
+	end = filebno + n;
+	for (bno = filebno; bno < end; bno += got) {
+		if ((r = file_block_walk(f, bno, &pdiskbno, 1)) < 0)
+			return r;
+		if (*pdiskbno) {
+			got = 1;
+			continue;
+		}
+
+		// How many file blocks in a row are missing from here?
+		for (want = 1; bno + want < end; want++)
+			if ((r = file_block_walk(f, bno + want, &pdiskbno, 1)) < 0
+			    || *pdiskbno)
+				break;
+
+		goal = alloc_hint;
+		if (bno > 0 && file_block_walk(f, bno - 1, &prev, 0) == 0 && *prev)
+			goal = *prev + 1;
+		if ((r = alloc_run(goal, want, &got)) < 0)
+			return r;
+		first = r;
+
+		for (i = 0; i < got; i++) {
+			if ((r = file_block_walk(f, bno + i, &pdiskbno, 1)) < 0)
+				return r;
+			*pdiskbno = first + i;
+			journal_write(pdiskbno);
+			bc_zero_block(first + i);
+		}
+	}
+	return 0;
+}
+
+// Set *blk to the address in memory where the filebno'th
+// block of file 'f' would be mapped.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_NO_DISK if a block needed to be allocated but the disk is full.
+//	-E_INVAL if filebno is out of range.
+int
+file_get_block(struct File *f, uint32_t filebno, char **blk)
+{
+	uint32_t *pdiskbno;
+	int r;
+
+	if ((r = file_block_walk(f, filebno, &pdiskbno, 1)) < 0)
+		return r;
+	if (!*pdiskbno) {
+		if ((r = file_alloc_blocks(f, filebno, 1)) < 0)
+			return r;
+	}
+	*blk = diskaddr(*pdiskbno);
+	return 0;
+}
+
+// --------------------------------------------------------------
+// Directory index
+// --------------------------------------------------------------
+
+// A directory of more than one block gets a hash index, so that looking
+// up a name costs a probe or two rather than a scan of every directory
+// block.  The entries themselves stay a flat array of struct File, which
+// code that knows nothing of the index can still read.
+//
+// The index is an open-addressing hash table filling f_hblocks (a power
+// of two) contiguous blocks from f_hindex.  A slot is 0 if empty,
+// HSLOT_DELETED if its entry was removed, and otherwise holds the top
+// 16 bits of the name's hash, so most mismatches are rejected without
+// touching a directory block, over 1 + the entry's number in the
+// directory (filebno * BLKFILES + index in the block).
+
+#define HSLOT_DELETED		0xFFFFFFFF
+#define HSLOT(hash, ent)	(((hash) & 0xFFFF0000) | ((ent) + 1))
+#define HSLOT_ENT(slot)		(((slot) & 0xFFFF) - 1)
+#define HSLOTS_PER_BLOCK	(BLKSIZE / 4)
+#define DIR_HMINBLOCKS		2	// directory size that gets an index
+
+static uint32_t
+name_hash(const char *name)
+{
+	return crc32c(0, name, strlen(name));
+}
+
+// Set *pf to entry number 'ent' of directory 'dir'.
+static int
+dir_entry(struct File *dir, uint32_t ent, struct File **pf)
+{
+	char *blk;
+	int r;
+
+	if ((r = file_get_block(dir, ent / BLKFILES, &blk)) < 0)
+		return r;
+	*pf = (struct File *) blk + ent % BLKFILES;
+	return 0;
+}
+
+// Probe the index of 'dir' for 'name', whose hash is 'hash'.
+// Sets *pslot to the slot naming it and *pf to the entry on success.
+// Otherwise sets *pslot to the slot a new entry for it should take.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_NOT_FOUND if the name is not in the directory.
+static int
+dir_hfind(struct File *dir, const char *name, uint32_t hash,
+	  uint32_t **pslot, struct File **pf)
+{
+	uint32_t *tab, *free, nslots, i, n;
+	struct File *f;
+
+	tab = diskaddr(dir->f_hindex);
+	nslots = dir->f_hblocks * HSLOTS_PER_BLOCK;
+	free = 0;
+	for (i = hash % nslots, n = 0; n < nslots && tab[i] != 0;
+	     i = (i + 1) % nslots, n++) {
+		if (tab[i] == HSLOT_DELETED) {
+			if (!free)
+				free = &tab[i];
+		} else if (((tab[i] ^ hash) & 0xFFFF0000) == 0
+			   && dir_entry(dir, HSLOT_ENT(tab[i]), &f) == 0
+			   && strcmp(f->f_name, name) == 0) {
+			*pslot = &tab[i];
+			*pf = f;
+			return 0;
+		}
+	}
+	*pslot = free ? free : &tab[i];
+	return -E_NOT_FOUND;
+}
+
+// Free the index of 'dir', if it has one.
+static void
+dir_hdrop(struct File *dir)
+{
+	uint32_t i;
+
+	for (i = 0; dir->f_hindex && i < dir->f_hblocks; i++)
+		free_block(dir->f_hindex + i);
+	dir->f_hindex = dir->f_hblocks = dir->f_hused = 0;
+	journal_write(dir);
+}
+
+// Replace the index of 'dir' with a new one, sized so it stays under
+// three-quarters full even if every entry the directory has room for
+// is used, and fill it from the directory's entries.  If there is no
+// room on the disk, the directory is left without an index.
+static void
+dir_hbuild(struct File *dir)
+{
+	uint32_t nblock, nblocks, got, ent, hash, *slot;
+	struct File *f, *g;
+	int r;
+
+	// Entry numbers must fit in the low 16 bits of a slot.
+	static_assert((NDIRECT + NINDIRECT) * BLKFILES < 0xFFFF);
+
+	nblock = dir->f_size / BLKSIZE;
+	for (nblocks = 1; nblocks * HSLOTS_PER_BLOCK * 3 < nblock * BLKFILES * 4; )
+		nblocks *= 2;
+
+	dir_hdrop(dir);
+	if (nblocks > BC_MAXRUN || (r = alloc_run(0, nblocks, &got)) < 0)
+		return;
+	if (got < nblocks) {
+		while (got > 0)
+			free_block(r + --got);
+		return;
+	}
+	for (got = 0; got < nblocks; got++)
+		bc_zero_block(r + got);
+	dir->f_hindex = r;
+	dir->f_hblocks = nblocks;
+
+	for (ent = 0; ent < nblock * BLKFILES; ent++) {
+		if (dir_entry(dir, ent, &f) < 0 || f->f_name[0] == '\0')
+			continue;
+		hash = name_hash(f->f_name);
+		if (dir_hfind(dir, f->f_name, hash, &slot, &g) == 0)
+			continue;
+		*slot = HSLOT(hash, ent);
+		dir->f_hused++;
+	}
+
+	for (got = 0; got < nblocks; got++)
+		journal_write(diskaddr(dir->f_hindex + got));
+	journal_write(dir);
+}
+
+// Add entry number 'ent', just named, to the index of 'dir', creating
+// or enlarging the index if the directory has outgrown it.
+static void
+dir_hadd(struct File *dir, uint32_t ent)
+{
+	uint32_t nslots, hash, *slot;
+	struct File *f, *g;
+
+	nslots = dir->f_hblocks * HSLOTS_PER_BLOCK;
+	if (dir->f_size / BLKSIZE < DIR_HMINBLOCKS)
+		return;
+	if (!dir->f_hindex || (dir->f_hused + 1) * 4 > nslots * 3
+	    || nslots * 3 < dir->f_size / BLKSIZE * BLKFILES * 4) {
+		dir_hbuild(dir);
+		return;
+	}
+	if (dir_entry(dir, ent, &f) < 0)
+		return;
+	hash = name_hash(f->f_name);
+	if (dir_hfind(dir, f->f_name, hash, &slot, &g) == 0)
+		return;
+	if (*slot == 0)
+		dir->f_hused++;
+	*slot = HSLOT(hash, ent);
+	journal_write(slot);
+	journal_write(dir);
+}
+
+// Remove the entry for 'name' from the index of 'dir'.
+static void
+dir_hremove(struct File *dir, const char *name)
+{
+	uint32_t *slot;
+	struct File *f;
+
+	if (dir->f_hindex
+	    && dir_hfind(dir, name, name_hash(name), &slot, &f) == 0) {
+		*slot = HSLOT_DELETED;
+		journal_write(slot);
+	}
+}
+
+// The server also remembers recent lookups in memory, keyed by the
+// directory and the name, so walking a hot path touches no directory
+// or index blocks at all.  An entry is only trusted if the file it
+// points at still has that name, so removing a file needs no
+// invalidation.
+
+#define NNAMECACHE	256
+
+struct NameCache {
+	struct File *nc_dir;
+	struct File *nc_file;
+	char nc_name[MAXNAMELEN];
+};
+
+static struct NameCache namecache[NNAMECACHE];
+
+static struct NameCache *
+namecache_slot(struct File *dir, uint32_t hash)
+{
+	return &namecache[(hash ^ ((uintptr_t) dir >> 8)) % NNAMECACHE];
+}
+
+// Try to find a file named "name" in dir.  If so, set *file to it.
+// 'hash' is name_hash(name).
+//
+// Returns 0 and sets *file on success, < 0 on error.  Errors are:
+//	-E_NOT_FOUND if the file is not found
+static int
+dir_lookup(struct File *dir, const char *name, uint32_t hash, struct File **file)
+{
+	int r;
+	uint32_t i, j, nblock, *slot;
+	char *blk;
+	struct File *f;
+	struct NameCache *nc;
+
+	nc = namecache_slot(dir, hash);
+	if (nc->nc_dir == dir && strcmp(nc->nc_name, name) == 0
+	    && strcmp(nc->nc_file->f_name, name) == 0) {
+		*file = nc->nc_file;
+		return 0;
+	}
+
+	// Search dir for name.
+	// We maintain the invariant that the size of a directory-file
+	// is always a multiple of the file system's block size.
+	assert((dir->f_size % BLKSIZE) == 0);
+	nblock = dir->f_size / BLKSIZE;
+	if (!dir->f_hindex && nblock >= DIR_HMINBLOCKS)
+		dir_hbuild(dir);
+	if (dir->f_hindex) {
+		if ((r = dir_hfind(dir, name, hash, &slot, &f)) < 0)
+			return r;
+		goto found;
+	}
+	for (i = 0; i < nblock; i++) {
+		if ((r = file_get_block(dir, i, &blk)) < 0)
+			return r;
+		f = (struct File*) blk;
+		for (j = 0; j < BLKFILES; j++)
+			if (strcmp(f[j].f_name, name) == 0) {
+				f = &f[j];
+				goto found;
+			}
+	}
+	return -E_NOT_FOUND;
+
+found:
+	nc->nc_dir = dir;
+	nc->nc_file = f;
+	strcpy(nc->nc_name, name);
+	*file = f;
+	return 0;
+}
+
+// Set *file to point at a free File structure in dir, and *pent to its
+// entry number in dir.  The caller is responsible for filling in the
+// File fields and then adding the entry to the index with dir_hadd.
+static int
+dir_alloc_file(struct File *dir, struct File **file, uint32_t *pent)
+{
+	int r;
+	uint32_t nblock, i, j;
+	char *blk;
+	struct File *f;
+
+	assert((dir->f_size % BLKSIZE) == 0);
+	nblock = dir->f_size / BLKSIZE;
+	for (i = 0; i < nblock; i++) {
+		if ((r = file_get_block(dir, i, &blk)) < 0)
+			return r;
+		f = (struct File*) blk;
+		for (j = 0; j < BLKFILES; j++)
+			if (f[j].f_name[0] == '\0') {
+				*file = &f[j];
+				*pent = i * BLKFILES + j;
+				return 0;
+			}
+	}
+	dir->f_size += BLKSIZE;
+	if ((r = file_get_block(dir, i, &blk)) < 0)
+		return r;
+	f = (struct File*) blk;
+	*file = &f[0];
+	*pent = i * BLKFILES;
+	return 0;
+}
+
+// Skip over slashes.
+static const char*
+skip_slash(const char *p)
+{
+	while (*p == '/')
+		p++;
+	return p;
+}
+
+// Evaluate a path name, starting at the root.
+// On success, set *pf to the file we found
+// and set *pdir to the directory the file is in.
+// If we cannot find the file but find the directory
+// it should be in, set *pdir and copy the final path
+// element into lastelem.
+static int
+walk_path(const char *path, struct File **pdir, struct File **pf, char *lastelem)
+{
+	const char *p;
+	char name[MAXNAMELEN];
+	struct File *dir, *f;
+	int r;
+
+	path = skip_slash(path);
+	f = &super->s_root;
+	dir = 0;
+	name[0] = 0;
+
+	if (pdir)
+		*pdir = 0;
+	*pf = 0;
+	while (*path != '\0') {
+		dir = f;
+		p = path;
+		while (*path != '/' && *path != '\0')
+			path++;
+		if (path - p >= MAXNAMELEN)
+			return -E_BAD_PATH;
+		memmove(name, p, path - p);
+		name[path - p] = '\0';
+		path = skip_slash(path);
+
+		if (dir->f_type != FTYPE_DIR)
+			return -E_NOT_FOUND;
+
+		if ((r = dir_lookup(dir, name, name_hash(name), &f)) < 0) {
+			if (r == -E_NOT_FOUND && *path == '\0') {
+				if (pdir)
+					*pdir = dir;
+				if (lastelem)
+					strcpy(lastelem, name);
+				*pf = 0;
+			}
+			return r;
+		}
+	}
+
+	if (pdir)
+		*pdir = dir;
+	*pf = f;
+	return 0;
+}
+
+// --------------------------------------------------------------
+// File operations
+// --------------------------------------------------------------
+
+static void file_journal(struct File *f);
+
+// Create "path".  On success set *pf to point at the file and return 0.
+// On error return < 0.
+int
+file_create(const char *path, struct File **pf)
+{
+	char name[MAXNAMELEN];
+	uint32_t ent;
+	int r;
+	struct File *dir, *f;
+
+	if ((r = walk_path(path, &dir, &f, name)) == 0)
+		return -E_FILE_EXISTS;
+	if (r != -E_NOT_FOUND || dir == 0)
+		return r;
+	if ((r = dir_alloc_file(dir, &f, &ent)) < 0)
+		return r;
+
+	memset(f, 0, sizeof(*f));
+	strcpy(f->f_name, name);
+	dir_hadd(dir, ent);
+	*pf = f;
+	file_journal(dir);
+	return 0;
+}
+
+// Open "path".  On success set *pf to point at the file and return 0.
+// On error return < 0.
+int
+file_open(const char *path, struct File **pf)
+{
+	return walk_path(path, 0, pf, 0);
+}
+
+// Read count bytes from f into buf, starting from seek position
+// offset.  This meant to mimic the standard pread function.
+// Returns the number of bytes read, < 0 on error.
+ssize_t
+file_read(struct File *f, void *buf, size_t count, off_t offset)
+{
+	int r, bn;
+	off_t pos;
+	char *blk;
+
+	if (offset >= f->f_size)
+		return 0;
+
+	count = MIN(count, f->f_size - offset);
+
+	for (pos = offset; pos < offset + count; ) {
+		if ((r = file_get_block(f, pos / BLKSIZE, &blk)) < 0)
+			return r;
+		bn = MIN(BLKSIZE - pos % BLKSIZE, offset + count - pos);
+		memmove(buf, blk + pos % BLKSIZE, bn);
+		pos += bn;
+		buf += bn;
+	}
+
+	return count;
+}
+
+
+// Write count bytes from buf into f, starting at seek position
+// offset.  This is meant to mimic the standard pwrite function.
+// Extends the file if necessary.
+// Returns the number of bytes written, < 0 on error.
+int
+file_write(struct File *f, const void *buf, size_t count, off_t offset)
+{
+	int r, bn;
+	off_t pos;
+	char *blk;
+
+	// Extend file if necessary
+	if (offset + count > f->f_size)
+		if ((r = file_set_size(f, offset + count)) < 0)
+			return r;
+
+	// Allocate the blocks being written as one extent up front,
+	// rather than one block at a time as the loop reaches them.
+	if (count > 0 && (r = file_alloc_blocks(f, offset / BLKSIZE,
+			(offset + count - 1) / BLKSIZE - offset / BLKSIZE + 1)) < 0)
+		return r;
+
+	for (pos = offset; pos < offset + count; ) {
+		if ((r = file_get_block(f, pos / BLKSIZE, &blk)) < 0)
+			return r;
+		bn = MIN(BLKSIZE - pos % BLKSIZE, offset + count - pos);
+		memmove(blk + pos % BLKSIZE, buf, bn);
+		pos += bn;
+		buf += bn;
+	}
+
+	return count;
+}
+
+// Remove a block from file f.  If it's not there, just silently succeed.
+// Returns 0 on success, < 0 on error.
+static int
+file_free_block(struct File *f, uint32_t filebno)
+{
+	int r;
+	uint32_t *ptr;
+
+	if ((r = file_block_walk(f, filebno, &ptr, 0)) < 0)
+		return r;
+	if (*ptr) {
+		free_block(*ptr);
+		*ptr = 0;
+		journal_write(ptr);
+	}
+	return 0;
+}
+
+// Remove any blocks currently used by file 'f',
+// but not necessary for a file of size 'newsize'.
+// For both the old and new sizes, figure out the number of blocks required,
+// and then clear the blocks from new_nblocks to old_nblocks.
+// If the new_nblocks is no more than NDIRECT, and the indirect block has
+// been allocated (f->f_indirect != 0), then free the indirect block too.
+// (Remember to clear the f->f_indirect pointer so you'll know
+// whether it's valid!)
+// Do not change f->f_size.
+static void
+file_truncate_blocks(struct File *f, off_t newsize)
+{
+	int r;
+	uint32_t bno, old_nblocks, new_nblocks;
+
+	old_nblocks = (f->f_size + BLKSIZE - 1) / BLKSIZE;
+	new_nblocks = (newsize + BLKSIZE - 1) / BLKSIZE;
+	for (bno = new_nblocks; bno < old_nblocks; bno++)
+		if ((r = file_free_block(f, bno)) < 0)
+			cprintf("warning: file_free_block: %e", r);
+
+	if (new_nblocks <= NDIRECT && f->f_indirect) {
+		free_block(f->f_indirect);
+		f->f_indirect = 0;
+		journal_write(f);
+	}
+
+	// The index and the name cache refer to entries by position;
+	// rebuild the index when it is next needed.
+	if (f->f_type == FTYPE_DIR && new_nblocks < old_nblocks) {
+		dir_hdrop(f);
+		memset(namecache, 0, sizeof(namecache));
+	}
+}
+
+// Set the size of file f, truncating or extending as necessary.
+int
+file_set_size(struct File *f, off_t newsize)
+{
+	if (f->f_size > newsize)
+		file_truncate_blocks(f, newsize);
+	f->f_size = newsize;
+	journal_write(f);
+	return 0;
+}
+
+// Add the changed metadata of file f to the journal's running
+// transaction: its File, its indirect block and, for a directory, its
+// blocks and index.  The change is durable at the next commit.
+static void
+file_journal(struct File *f)
+{
+	uint32_t i, *pdiskbno;
+
+	for (i = 0; f->f_type == FTYPE_DIR && i < f->f_size / BLKSIZE; i++)
+		if (file_block_walk(f, i, &pdiskbno, 0) == 0 && *pdiskbno)
+			journal_write(diskaddr(*pdiskbno));
+	for (i = 0; f->f_type == FTYPE_DIR && i < f->f_hblocks; i++)
+		journal_write(diskaddr(f->f_hindex + i));
+	journal_write(f);
+	if (f->f_indirect)
+		journal_write(diskaddr(f->f_indirect));
+}
+
+// Flush the contents and metadata of file f out to disk.
+// Loop over all the blocks in file.
+// Translate the file block number into a disk block number
+// and gather runs of blocks that are adjacent on disk, so that
+// flush_blocks can write each run of dirty blocks with one command.
+// Then commit the metadata, which now points only at data that is
+// on disk.
+void
+file_flush(struct File *f)
+{
+	uint32_t i, first, len;
+	uint32_t *pdiskbno;
+
+	first = len = 0;
+	for (i = 0; f->f_type != FTYPE_DIR && i < (f->f_size + BLKSIZE - 1) / BLKSIZE; i++) {
+		if (file_block_walk(f, i, &pdiskbno, 0) < 0 ||
+		    pdiskbno == NULL || *pdiskbno == 0)
+			continue;
+		if (len > 0 && *pdiskbno == first + len) {
+			len++;
+			continue;
+		}
+		if (len > 0)
+			flush_blocks(first, len);
+		first = *pdiskbno;
+		len = 1;
+	}
+	if (len > 0)
+		flush_blocks(first, len);
+	file_journal(f);
+	journal_commit();
+}
+
+// Start reading blocks of f from 'filebno' on into the cache in the
+// background, about to be needed by a sequential reader that reads
+// up to n blocks ahead.  Nothing is done while at least half of those
+// are already cached or in flight, so that each read-ahead is one
+// large disk command rather than a block at a time.  Only a run of
+// blocks that is contiguous on disk is read.
+void
+file_readahead(struct File *f, uint32_t filebno, uint32_t n)
+{
+	uint32_t *pdiskbno, nblocks, bno, first, len;
+
+	nblocks = (f->f_size + BLKSIZE - 1) / BLKSIZE;
+	for (bno = filebno; bno < nblocks; bno++)
+		if (file_block_walk(f, bno, &pdiskbno, 0) < 0 || !*pdiskbno
+		    || !bc_is_cached(*pdiskbno))
+			break;
+	if (bno - filebno >= n / 2)
+		return;
+
+	first = 0;
+	for (len = 0; bno + len < nblocks && len < n; len++) {
+		if (file_block_walk(f, bno + len, &pdiskbno, 0) < 0 || !*pdiskbno)
+			break;
+		if (len == 0)
+			first = *pdiskbno;
+		else if (*pdiskbno != first + len)
+			break;
+		if (bc_is_cached(*pdiskbno))
+			break;
+	}
+	if (len > 0)
+		bc_readahead(first, len);
+}
+
+// Note a read of n bytes at 'offset' in f by a reader whose read
+// pattern is tracked in *ra, and if it continues where the last one
+// ended, prefetch the blocks the next reads will want.  The window
+// starts at RA_MIN blocks on the first sequential read and doubles
+// with each one after that.
+void
+file_read_noted(struct File *f, struct ReadAhead *ra, off_t offset, size_t n)
+{
+	uint32_t bno = offset / BLKSIZE;
+
+	if (bno == ra->ra_next)
+		ra->ra_win = MIN(MAX(2 * ra->ra_win, RA_MIN), RA_MAX);
+	else
+		ra->ra_win = 0;
+	ra->ra_next = (offset + n) / BLKSIZE;
+	if (ra->ra_win)
+		file_readahead(f, ra->ra_next, ra->ra_win);
+}
+
+// Remove a file.  The root directory has no parent to remove it from,
+// so removing "/" fails with -E_INVAL.
+int
+file_remove(const char *path)
+{
+	int r;
+	struct File *dir, *f;
+
+	if ((r = walk_path(path, &dir, &f, 0)) < 0)
+		return r;
+	if (dir == 0)
+		return -E_INVAL;
+
+	file_truncate_blocks(f, 0);
+	dir_hremove(dir, f->f_name);
+	f->f_name[0] = '\0';
+	f->f_size = 0;
+	file_journal(dir);
+
+	return 0;
+}
+
+// Sync the entire file system.  A big hammer.
+void
+fs_sync(void)
+{
+	journal_commit();
+	journal_checkpoint();
+	flush_blocks(1, super->s_nblocks - 1);
+}
+
@@ -0,0 +1,95 @@
+#include <inc/fs.h>
+#include <inc/lib.h>
+
+#define SECTSIZE	512			// bytes per disk sector
+#define BLKSECTS	(BLKSIZE / SECTSIZE)	// sectors per block
+#define BC_MAXRUN	(256 / BLKSECTS)	// blocks per disk command
+// Most metadata blocks one request can change: a directory index of up
+// to BC_MAXRUN blocks when one is rebuilt, plus bitmap, directory and
+// indirect blocks.
+#define JOURNAL_REQBLOCKS	(BC_MAXRUN + 8)
+
+/* Disk block n, when in memory, is mapped into the file system
+ * server's address space at DISKMAP + (n*BLKSIZE). */
+#define DISKMAP		0x10000000
+
+/* Maximum disk size we can handle (3GB) */
+#define DISKSIZE	0xC0000000
+
+extern struct Super *super;	// superblock
+extern uint32_t *bitmap;	// bitmap blocks mapped in memory
+
+/* ide.c */
+bool	ide_probe_disk1(void);
+void	ide_set_disk(int diskno);
+void	ide_init(void);
+int	ide_read(uint32_t secno, void *dst, size_t nsecs);
+int	ide_write(uint32_t secno, const void *src, size_t nsecs);
+int	ide_read_async(uint32_t secno, void *dst, size_t nsecs);
+int	ide_read_wait(void);
+bool	ide_read_done(void);
+
+/* bc.c */
+struct BcStats {
+	uint32_t misses;	// blocks read one at a time on a fault
+	uint32_t ra_cmds;	// read-ahead disk commands
+	uint32_t ra_blocks;	// blocks read by them
+};
+extern struct BcStats bc_stats;
+
+void*	diskaddr(uint32_t blockno);
+bool	va_is_mapped(void *va);
+bool	va_is_dirty(void *va);
+void	flush_block(void *addr);
+void	flush_blocks(uint32_t blockno, uint32_t n);
+bool	bc_is_cached(uint32_t blockno);
+void	bc_readahead(uint32_t blockno, uint32_t n);
+void	bc_readahead_wait(void);
+void	bc_readahead_poll(void);
+void	bc_clean(uint32_t blockno);
+void	bc_write_run(uint32_t blockno, const void *src, uint32_t n);
+void	bc_zero_block(uint32_t blockno);
+void	bc_init(void);
+void	bc_drop(void);
+
+/* fs.c */
+// A reader's sequential read detection for file_read_noted.  The
+// read-ahead window is bounded by RA_MIN and RA_MAX blocks.
+struct ReadAhead {
+	uint32_t ra_next;	// block where a sequential read would go on
+	uint32_t ra_win;	// read-ahead window in blocks, 0 if random
+};
+#define RA_MIN		4
+#define RA_MAX		BC_MAXRUN
+
+void	fs_init(void);
+int	file_get_block(struct File *f, uint32_t file_blockno, char **pblk);
+int	file_create(const char *path, struct File **f);
+int	file_open(const char *path, struct File **f);
+ssize_t	file_read(struct File *f, void *buf, size_t count, off_t offset);
+int	file_write(struct File *f, const void *buf, size_t count, off_t offset);
+int	file_set_size(struct File *f, off_t newsize);
+void	file_flush(struct File *f);
+void	file_readahead(struct File *f, uint32_t filebno, uint32_t n);
+void	file_read_noted(struct File *f, struct ReadAhead *ra, off_t offset, size_t n);
+int	file_remove(const char *path);
+void	fs_sync(void);
+
+/* journal.c */
+void	journal_init(void);
+void	journal_write(void *addr);
+bool	journal_holds(uint32_t blockno);
+void	journal_reuse(uint32_t first, uint32_t n);
+void	journal_commit(void);
+void	journal_checkpoint(void);
+void	journal_replay(void);
+void	journal_request_done(void);
+
+/* int	map_block(uint32_t); */
+bool	block_is_free(uint32_t blockno);
+int	alloc_block(void);
+int	alloc_run(uint32_t goal, uint32_t want, uint32_t *nalloc);
+
+/* test.c */
+void	fs_test(void);
+
@@ -0,0 +1,385 @@
+/*
+ * IDE driver for the file system server.
+ *
+ * Whole blocks move in one command: with bus-master DMA when the PCI
+ * IDE controller supports it, otherwise with READ/WRITE MULTIPLE so a
+ * 4KB block costs one interrupt rather than eight.  The server sleeps
+ * in sys_irq_wait while the disk works instead of spinning on status,
+ * or, for read-ahead, leaves a DMA read running and goes on serving.
+ * For information about what all this IDE/ATA magic means,
+ * see the materials available on the class references page.
+ */
+
+#include "fs.h"
+#include <inc/x86.h>
+
+// Primary channel command block and control registers
+#define IDE_DATA	0x1F0
+#define IDE_NSECT	0x1F2
+#define IDE_LBA0	0x1F3
+#define IDE_LBA1	0x1F4
+#define IDE_LBA2	0x1F5
+#define IDE_DRIVE	0x1F6
+#define IDE_CMD		0x1F7	// status when read
+#define IDE_CTRL	0x3F6	// bit 1 masks the interrupt (nIEN)
+
+#define IDE_BSY		0x80
+#define IDE_DRDY	0x40
+#define IDE_DF		0x20
+#define IDE_DRQ		0x08
+#define IDE_ERR		0x01
+
+#define ATA_READ_SECTORS	0x20
+#define ATA_WRITE_SECTORS	0x30
+#define ATA_READ_MULTIPLE	0xC4
+#define ATA_WRITE_MULTIPLE	0xC5
+#define ATA_SET_MULTIPLE	0xC6
+#define ATA_READ_DMA		0xC8
+#define ATA_WRITE_DMA		0xCA
+#define ATA_IDENTIFY		0xEC
+
+// Bus-master IDE registers for the primary channel, relative to BAR4
+#define BM_CMD		0
+#define BM_STATUS	2
+#define BM_PRDT		4
+
+#define BM_CMD_START	0x01
+#define BM_CMD_READ	0x08	// device to memory
+#define BM_STATUS_ERR	0x02
+#define BM_STATUS_IRQ	0x04
+
+// PCI configuration space access
+#define PCI_CONF_ADDR	0xCF8
+#define PCI_CONF_DATA	0xCFC
+#define PCI_CLASS_IDE	0x0101
+#define PCI_CMD_IO	0x01
+#define PCI_CMD_MASTER	0x04
+
+// Physical region descriptor: one physically contiguous piece of a
+// DMA transfer, which must not cross a 64KB boundary.
+struct PRD {
+	uint32_t prd_addr;
+	uint16_t prd_len;
+	uint16_t prd_flags;
+};
+#define PRD_EOT		0x8000	// last descriptor in the table
+
+// Enough descriptors for 256 sectors from an unaligned buffer.
+#define NPRD		(256 * SECTSIZE / PGSIZE + 1)
+
+static struct PRD prdt[NPRD] __attribute__((aligned(PGSIZE)));
+
+static int diskno = 1;
+static uint16_t bm_base;	// bus-master I/O base, 0 if no DMA
+static int multiple = 1;	// sectors per interrupt in PIO mode
+static bool dma_busy;		// an ide_read_async transfer is outstanding
+
+static int
+ide_wait_ready(bool check_error)
+{
+	int r;
+
+	while (((r = inb(IDE_CMD)) & (IDE_BSY|IDE_DRDY)) != IDE_DRDY)
+		/* do nothing */;
+
+	if (check_error && (r & (IDE_DF|IDE_ERR)) != 0)
+		return -1;
+	return 0;
+}
+
+// Sleep until the disk interrupts, then wait for it to be ready.
+// Reading the status register also acknowledges the interrupt.
+static int
+ide_wait_intr(bool check_error)
+{
+	sys_irq_wait(IRQ_IDE);
+	return ide_wait_ready(check_error);
+}
+
+bool
+ide_probe_disk1(void)
+{
+	int r, x;
+
+	// wait for Device 0 to be ready
+	ide_wait_ready(0);
+
+	// switch to Device 1
+	outb(IDE_DRIVE, 0xE0 | (1<<4));
+
+	// check for Device 1 to be ready for a while
+	for (x = 0;
+	     x < 1000 && ((r = inb(IDE_CMD)) & (IDE_BSY|IDE_DF|IDE_ERR)) != 0;
+	     x++)
+		/* do nothing */;
+
+	// switch back to Device 0
+	outb(IDE_DRIVE, 0xE0 | (0<<4));
+
+	cprintf("Device 1 presence: %d\n", (x < 1000));
+	return (x < 1000);
+}
+
+static uint32_t
+pci_conf_read(int dev, int func, int off)
+{
+	outl(PCI_CONF_ADDR, 0x80000000 | (dev << 11) | (func << 8) | off);
+	return inl(PCI_CONF_DATA);
+}
+
+static void
+pci_conf_write(int dev, int func, int off, uint32_t v)
+{
+	outl(PCI_CONF_ADDR, 0x80000000 | (dev << 11) | (func << 8) | off);
+	outl(PCI_CONF_DATA, v);
+}
+
+// Find the first IDE controller on PCI bus 0, turn on bus mastering,
+// and return its bus-master register base, or 0 if there is none.
+static uint16_t
+pci_find_busmaster(void)
+{
+	int dev, func;
+	uint32_t bar4;
+
+	for (dev = 0; dev < 32; dev++)
+		for (func = 0; func < 8; func++) {
+			if ((pci_conf_read(dev, func, 0x00) & 0xFFFF) == 0xFFFF)
+				continue;
+			if ((pci_conf_read(dev, func, 0x08) >> 16) != PCI_CLASS_IDE)
+				continue;
+			bar4 = pci_conf_read(dev, func, 0x20);
+			if (!(bar4 & 1) || !(bar4 & ~3))
+				continue;
+			pci_conf_write(dev, func, 0x04, pci_conf_read(dev, func, 0x04)
+				       | PCI_CMD_IO | PCI_CMD_MASTER);
+			return bar4 & 0xFFFC;
+		}
+	return 0;
+}
+
+static void
+ide_select(uint32_t secno, size_t nsecs)
+{
+	outb(IDE_NSECT, nsecs);		// 0 means 256
+	outb(IDE_LBA0, secno & 0xFF);
+	outb(IDE_LBA1, (secno >> 8) & 0xFF);
+	outb(IDE_LBA2, (secno >> 16) & 0xFF);
+	outb(IDE_DRIVE, 0xE0 | ((diskno&1)<<4) | ((secno>>24)&0x0F));
+}
+
+// Choose the fastest transfer mode the current disk supports.
+void
+ide_init(void)
+{
+	uint16_t id[256];
+
+	// Interrupts on; sys_irq_wait unmasks IRQ 14 at the PIC.
+	outb(IDE_CTRL, 0);
+
+	ide_wait_ready(0);
+	outb(IDE_DRIVE, 0xE0 | ((diskno&1)<<4));
+	outb(IDE_CMD, ATA_IDENTIFY);
+	if (ide_wait_intr(1) < 0 || !(inb(IDE_CMD) & IDE_DRQ)) {
+		cprintf("ide: IDENTIFY failed, using single-sector PIO\n");
+		return;
+	}
+	insl(IDE_DATA, id, sizeof(id) / 4);
+
+	// Word 47: maximum sectors per READ/WRITE MULTIPLE interrupt.
+	if ((id[47] & 0xFF) >= BLKSECTS) {
+		ide_select(0, BLKSECTS);
+		outb(IDE_CMD, ATA_SET_MULTIPLE);
+		if (ide_wait_intr(1) == 0)
+			multiple = BLKSECTS;
+	}
+
+	// Word 49 bit 8: DMA supported.
+	if (id[49] & (1 << 8))
+		bm_base = pci_find_busmaster();
+
+	if (bm_base)
+		cprintf("ide: bus-master DMA at port %04x\n", bm_base);
+	else
+		cprintf("ide: PIO, %d sectors per interrupt\n", multiple);
+}
+
+void
+ide_set_disk(int d)
+{
+	if (d != 0 && d != 1)
+		panic("bad disk number");
+	diskno = d;
+}
+
+// Describe [buf, buf + len) in prdt.  Returns the physical address of
+// the table, or 0 if part of the buffer is not mapped.
+static physaddr_t
+prdt_build(const void *buf, size_t len)
+{
+	uintptr_t va = (uintptr_t) buf;
+	size_t n;
+	int i;
+
+	for (i = 0; len > 0; i++, va += n, len -= n) {
+		if (!va_is_mapped((void *) va))
+			return 0;
+		n = MIN(len, PGSIZE - PGOFF(va));
+		prdt[i].prd_addr = PTE_ADDR(uvpt[PGNUM(va)]) | PGOFF(va);
+		prdt[i].prd_len = n;
+		prdt[i].prd_flags = 0;
+	}
+	prdt[i - 1].prd_flags = PRD_EOT;
+	return PTE_ADDR(uvpt[PGNUM(prdt)]) | PGOFF(prdt);
+}
+
+// Start a DMA transfer of nsecs sectors between the disk and 'buf'.
+// Returns 1 if the buffer can't be used for DMA, so the caller should
+// fall back to PIO; 0 once the transfer is under way.
+static int
+ide_dma_start(uint32_t secno, void *buf, size_t nsecs, bool write)
+{
+	physaddr_t prdt_pa;
+
+	if (!(prdt_pa = prdt_build(buf, nsecs * SECTSIZE)))
+		return 1;
+
+	ide_wait_ready(0);
+	outb(bm_base + BM_CMD, 0);
+	outl(bm_base + BM_PRDT, prdt_pa);
+	outb(bm_base + BM_STATUS, BM_STATUS_ERR | BM_STATUS_IRQ);
+	ide_select(secno, nsecs);
+	outb(IDE_CMD, write ? ATA_WRITE_DMA : ATA_READ_DMA);
+	outb(bm_base + BM_CMD, (write ? 0 : BM_CMD_READ) | BM_CMD_START);
+	return 0;
+}
+
+// Sleep until the DMA transfer started by ide_dma_start completes.
+// Returns 0 on success, < 0 on a disk error.
+static int
+ide_dma_finish(void)
+{
+	uint8_t status;
+	int r;
+
+	while (!((status = inb(bm_base + BM_STATUS)) & (BM_STATUS_IRQ | BM_STATUS_ERR)))
+		sys_irq_wait(IRQ_IDE);
+
+	outb(bm_base + BM_CMD, 0);
+	r = ide_wait_ready(1);
+	outb(bm_base + BM_STATUS, BM_STATUS_ERR | BM_STATUS_IRQ);
+	return (status & BM_STATUS_ERR) ? -1 : r;
+}
+
+// Transfer nsecs sectors between the disk and 'buf' by DMA.
+// Returns 1 if the buffer can't be used for DMA, so the caller should
+// fall back to PIO; 0 on success; < 0 on a disk error.
+static int
+ide_dma(uint32_t secno, void *buf, size_t nsecs, bool write)
+{
+	int r;
+
+	if ((r = ide_dma_start(secno, buf, nsecs, write)) != 0)
+		return r;
+	return ide_dma_finish();
+}
+
+int
+ide_read(uint32_t secno, void *dst, size_t nsecs)
+{
+	size_t n;
+	int r;
+
+	assert(nsecs <= 256);
+	assert(!dma_busy);
+
+	if (bm_base && (r = ide_dma(secno, dst, nsecs, 0)) <= 0)
+		return r;
+
+	ide_wait_ready(0);
+	ide_select(secno, nsecs);
+	outb(IDE_CMD, multiple > 1 ? ATA_READ_MULTIPLE : ATA_READ_SECTORS);
+
+	// The disk interrupts when each group of 'multiple' sectors is
+	// ready to be read.
+	for (; nsecs > 0; nsecs -= n, dst += n * SECTSIZE) {
+		if ((r = ide_wait_intr(1)) < 0)
+			return r;
+		n = MIN(nsecs, multiple);
+		insl(IDE_DATA, dst, n * SECTSIZE / 4);
+	}
+
+	return 0;
+}
+
+int
+ide_write(uint32_t secno, const void *src, size_t nsecs)
+{
+	size_t n;
+	int r;
+
+	assert(nsecs <= 256);
+	assert(!dma_busy);
+
+	if (bm_base && (r = ide_dma(secno, (void *) src, nsecs, 1)) <= 0)
+		return r;
+
+	ide_wait_ready(0);
+	ide_select(secno, nsecs);
+	outb(IDE_CMD, multiple > 1 ? ATA_WRITE_MULTIPLE : ATA_WRITE_SECTORS);
+
+	// The first group of sectors can go as soon as the disk is ready;
+	// after that the disk interrupts when it wants the next group,
+	// and once more when the last one is written.
+	if ((r = ide_wait_ready(1)) < 0)
+		return r;
+	for (; nsecs > 0; nsecs -= n, src += n * SECTSIZE) {
+		n = MIN(nsecs, multiple);
+		outsl(IDE_DATA, src, n * SECTSIZE / 4);
+		if ((r = ide_wait_intr(1)) < 0)
+			return r;
+	}
+
+	return 0;
+}
+
+// Start reading nsecs sectors into 'dst' and return without waiting
+// for the disk, if the controller can do the transfer by DMA.  The
+// server can go on serving requests while the disk works; no other
+// disk command may be issued until ide_read_wait has been called.
+// Returns 1 if the read is under way, 0 if it had to be done
+// synchronously and has already completed, < 0 on a disk error.
+int
+ide_read_async(uint32_t secno, void *dst, size_t nsecs)
+{
+	int r;
+
+	assert(nsecs <= 256);
+	assert(!dma_busy);
+
+	if (bm_base && (r = ide_dma_start(secno, dst, nsecs, 0)) == 0) {
+		dma_busy = 1;
+		return 1;
+	}
+	return ide_read(secno, dst, nsecs);
+}
+
+// Has the read started by ide_read_async, if any, finished?  If so,
+// ide_read_wait will return without sleeping.
+bool
+ide_read_done(void)
+{
+	return !dma_busy
+		|| (inb(bm_base + BM_STATUS) & (BM_STATUS_IRQ | BM_STATUS_ERR));
+}
+
+// Wait for the read started by ide_read_async, if any, to complete.
+// Returns 0 on success, < 0 on a disk error.
+int
+ide_read_wait(void)
+{
+	if (!dma_busy)
+		return 0;
+	dma_busy = 0;
+	return ide_dma_finish();
+}
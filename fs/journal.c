@@ -0,0 +1,236 @@
+#include <inc/string.h>
+#include <inc/crc.h>
+
+#include "fs.h"
+
+// Metadata journal.
+//
+// Instead of writing each changed metadata block (bitmap, directory,
+// indirect and index blocks, and the super block) as soon as it
+// changes, the file system adds it to the running transaction with
+// journal_write.  journal_commit writes a copy of every block in the
+// transaction to the journal, followed by the header that makes the
+// transaction count; that is the only synchronous metadata write, and
+// it covers any number of changes since the last commit.  Commits
+// happen when a client flushes a file or syncs, and between requests
+// once the journal might not have room for another one.  A request is
+// never split across transactions, so replay installs all of it or
+// none of it.
+//
+// The blocks reach their home locations only at the next checkpoint,
+// which writes them from the journal's copies, so the cached blocks
+// are free to change again meanwhile.  The checkpoint is put off
+// until the journal is needed for the next commit, or until a sync.
+// If the server stops before then, journal_replay installs the
+// transaction when it next starts.  A block freed and allocated again
+// must not be overwritten by an older logged copy, so alloc_run calls
+// journal_reuse for each run it hands out.
+//
+// File data is not journaled, but file_flush writes a file's data
+// before committing the metadata that points to it.
+
+static struct JournalHeader *jh;	// journal header, 0 if no journal
+static uint32_t jcap;			// most blocks a transaction can hold
+
+// The running transaction: metadata blocks changed since the last commit.
+static uint32_t jt_blocks[JOURNAL_MAXBLOCKS];
+static uint32_t jt_n;
+
+// Return the address of the journal's copy of the i'th logged block.
+static void *
+journal_copy(uint32_t i)
+{
+	return diskaddr(super->s_journal + 1 + i);
+}
+
+// Compute the CRC that commits the transaction described by jh.
+static uint32_t
+journal_crc(void)
+{
+	uint32_t crc, i;
+
+	crc = crc32c(0, &jh->jh_nblocks,
+		     sizeof(jh->jh_nblocks) + jh->jh_nblocks * sizeof(jh->jh_blocks[0]));
+	for (i = 0; i < jh->jh_nblocks; i++)
+		crc = crc32c(crc, journal_copy(i), BLKSIZE);
+	return crc;
+}
+
+// Find the journal and install any transaction left in it.
+void
+journal_init(void)
+{
+	if (super->s_journal == 0)
+		return;
+	if (super->s_jblocks < 2
+	    || super->s_journal + super->s_jblocks > super->s_nblocks)
+		panic("bad journal at block %d, %d blocks",
+		      super->s_journal, super->s_jblocks);
+
+	jh = diskaddr(super->s_journal);
+	jcap = MIN(super->s_jblocks - 1, JOURNAL_MAXBLOCKS);
+	if (jcap < JOURNAL_REQBLOCKS)
+		panic("journal of %d blocks is too small", super->s_jblocks);
+	journal_replay();
+}
+
+// Is block 'blockno' part of the running transaction?
+bool
+journal_holds(uint32_t blockno)
+{
+	uint32_t i;
+
+	for (i = 0; i < jt_n; i++)
+		if (jt_blocks[i] == blockno)
+			return 1;
+	return 0;
+}
+
+// Add the metadata block containing 'addr' to the running transaction
+// if it has been changed.  Without a journal, flush it instead.
+// journal_request_done leaves room for any one request, so running out
+// of room here means a request logs more than JOURNAL_REQBLOCKS blocks.
+void
+journal_write(void *addr)
+{
+	uint32_t blockno = ((uint32_t) addr - DISKMAP) / BLKSIZE;
+
+	if (!jh) {
+		flush_block(addr);
+		return;
+	}
+	if (!va_is_mapped(addr) || !va_is_dirty(addr) || journal_holds(blockno))
+		return;
+	if (jt_n == jcap)
+		panic("journal: request logs more than %d blocks", jcap);
+	jt_blocks[jt_n++] = blockno;
+}
+
+// Blocks [first, first + n) have just been allocated.  Whatever they
+// held before is dead, so take them out of the running transaction,
+// and write the committed transaction home now if it logs any of them:
+// checkpointing later would put the old copy over the new contents.
+void
+journal_reuse(uint32_t first, uint32_t n)
+{
+	uint32_t i, j;
+
+	if (!jh)
+		return;
+	for (i = j = 0; i < jt_n; i++)
+		if (jt_blocks[i] < first || jt_blocks[i] >= first + n)
+			jt_blocks[j++] = jt_blocks[i];
+	jt_n = j;
+
+	if (jh->jh_magic != JOURNAL_MAGIC)
+		return;
+	for (i = 0; i < jh->jh_nblocks; i++)
+		if (jh->jh_blocks[i] >= first && jh->jh_blocks[i] < first + n) {
+			journal_checkpoint();
+			return;
+		}
+}
+
+// Write the blocks of the committed transaction to their home
+// locations from the journal's copies, then mark the journal empty.
+// Blocks that are adjacent on disk go out in one command.
+void
+journal_checkpoint(void)
+{
+	uint32_t i, n;
+
+	if (!jh || jh->jh_magic != JOURNAL_MAGIC)
+		return;
+	for (i = 0; i < jh->jh_nblocks; i += n) {
+		for (n = 1; i + n < jh->jh_nblocks && n < BC_MAXRUN
+			     && jh->jh_blocks[i + n] == jh->jh_blocks[i] + n; n++)
+			/* do nothing */;
+		bc_write_run(jh->jh_blocks[i], journal_copy(i), n);
+	}
+	jh->jh_magic = 0;
+	flush_block(jh);
+}
+
+// Commit the running transaction.  Its blocks are copied into the
+// journal in disk order and written with as few commands as possible,
+// then the header is written.  The cached blocks are marked clean:
+// their contents are safe in the journal, and a later change sets
+// PTE_D again and puts them in the next transaction.
+void
+journal_commit(void)
+{
+	uint32_t i, j, b;
+
+	if (!jh || jt_n == 0)
+		return;
+
+	// The journal holds one transaction at a time.
+	journal_checkpoint();
+
+	for (i = 1; i < jt_n; i++)
+		for (j = i; j > 0 && jt_blocks[j - 1] > jt_blocks[j]; j--) {
+			b = jt_blocks[j];
+			jt_blocks[j] = jt_blocks[j - 1];
+			jt_blocks[j - 1] = b;
+		}
+
+	for (i = 0; i < jt_n; i++) {
+		if (!va_is_mapped(journal_copy(i)))
+			bc_zero_block(super->s_journal + 1 + i);
+		memmove(journal_copy(i), diskaddr(jt_blocks[i]), BLKSIZE);
+	}
+	flush_blocks(super->s_journal + 1, jt_n);
+
+	jh->jh_seq++;
+	jh->jh_nblocks = jt_n;
+	memmove(jh->jh_blocks, jt_blocks, jt_n * sizeof(jt_blocks[0]));
+	jh->jh_crc = journal_crc();
+	jh->jh_magic = JOURNAL_MAGIC;
+	flush_block(jh);
+
+	for (i = 0; i < jt_n; i++)
+		bc_clean(jt_blocks[i]);
+	jt_n = 0;
+}
+
+// Install the committed transaction, if the journal holds one that was
+// not checkpointed: copy its blocks into the cache and write them home.
+// A transaction whose header or copies do not match the CRC was never
+// committed, and is dropped.  There must be no running transaction.
+void
+journal_replay(void)
+{
+	uint32_t i;
+
+	if (!jh || jh->jh_magic != JOURNAL_MAGIC)
+		return;
+	assert(jt_n == 0);
+
+	if (jh->jh_nblocks > jcap || journal_crc() != jh->jh_crc) {
+		cprintf("journal: transaction %d incomplete, dropped\n", jh->jh_seq);
+		jh->jh_magic = 0;
+		flush_block(jh);
+		return;
+	}
+	for (i = 0; i < jh->jh_nblocks; i++)
+		if (jh->jh_blocks[i] == 0 || jh->jh_blocks[i] >= super->s_nblocks)
+			panic("journal: transaction %d logs bad block %08x",
+			      jh->jh_seq, jh->jh_blocks[i]);
+
+	cprintf("journal: replaying transaction %d, %d blocks\n",
+		jh->jh_seq, jh->jh_nblocks);
+	for (i = 0; i < jh->jh_nblocks; i++)
+		memmove(diskaddr(jh->jh_blocks[i]), journal_copy(i), BLKSIZE);
+	journal_checkpoint();
+	for (i = 0; i < jh->jh_nblocks; i++)
+		bc_clean(jh->jh_blocks[i]);
+}
+
+// Called after each request: start a new transaction unless the
+// running one still has room for the largest request.
+void
+journal_request_done(void)
+{
+	if (jh && jt_n + JOURNAL_REQBLOCKS > jcap)
+		journal_commit();
+}
@@ -5,13 +5,25 @@
 
 static char *msg = "This is the NEW message of the day!\n\n";
 
+// Has the change to the metadata block at va been saved, either by
+// writing it out or by adding it to the journal's running transaction?
+static bool
+saved(void *va)
+{
+	return !(uvpt[PGNUM(va)] & PTE_D)
+		|| journal_holds(((uint32_t) va - DISKMAP) / BLKSIZE);
+}
+
 void
 fs_test(void)
 {
 	struct File *f;
-	int r;
+	int r, i;
 	char *blk;
-	uint32_t *bits;
+	uint32_t *bits, bno;
+	char name[MAXNAMELEN];
+	struct ReadAhead ra;
+	struct BcStats stats;
 
 	// back up bitmap
 	if ((r = sys_page_alloc(0, (void*) PGSIZE, PTE_P|PTE_U|PTE_W)) < 0)
@@ -50,12 +62,12 @@ fs_test(void)
 	if ((r = file_set_size(f, 0)) < 0)
 		panic("file_set_size: %e", r);
 	assert(f->f_direct[0] == 0);
-	assert(!(uvpt[PGNUM(f)] & PTE_D));
+	assert(saved(f));
 	cprintf("file_truncate is good\n");
 
 	if ((r = file_set_size(f, strlen(msg))) < 0)
 		panic("file_set_size 2: %e", r);
-	assert(!(uvpt[PGNUM(f)] & PTE_D));
+	assert(saved(f));
 	if ((r = file_get_block(f, 0, &blk)) < 0)
 		panic("file_get_block 2: %e", r);
 	strcpy(blk, msg);
@@ -64,4 +76,121 @@ fs_test(void)
 	assert(!(uvpt[PGNUM(blk)] & PTE_D));
 	assert(!(uvpt[PGNUM(f)] & PTE_D));
 	cprintf("file rewrite is good\n");
+
+	// The commit in file_flush must survive losing the cached metadata
+	// before it is checkpointed.
+	bno = f->f_direct[0];
+	sys_page_unmap(0, ROUNDDOWN(f, PGSIZE));
+	journal_replay();
+	assert(f->f_direct[0] == bno);
+	assert(!block_is_free(bno));
+	cprintf("journal replay is good\n");
+
+	// Truncating a file frees its indirect block, which is still logged
+	// in the committed transaction; appending then reuses it for data.
+	// The data must not be overwritten when that transaction is
+	// checkpointed.  Each write is a request of its own, as it would
+	// be from a client.
+	if ((r = file_create("/reuse", &f)) < 0)
+		panic("file_create /reuse: %e", r);
+	memset(bits, 0x11, BLKSIZE);
+	for (i = 0; i <= NDIRECT; i++) {
+		if ((r = file_write(f, bits, BLKSIZE, i * BLKSIZE)) != BLKSIZE)
+			panic("file_write /reuse: %e", r);
+		journal_request_done();
+	}
+	file_flush(f);
+	bno = f->f_indirect;
+	if ((r = file_set_size(f, NDIRECT * BLKSIZE)) < 0)
+		panic("file_set_size /reuse: %e", r);
+	journal_request_done();
+	memset(bits, 0x22, BLKSIZE);
+	if ((r = file_write(f, bits, BLKSIZE, NDIRECT * BLKSIZE)) != BLKSIZE)
+		panic("file_write /reuse 2: %e", r);
+	file_flush(f);
+	if ((r = file_get_block(f, NDIRECT, &blk)) < 0)
+		panic("file_get_block /reuse: %e", r);
+	assert(blk == diskaddr(bno));
+	bc_drop();
+	assert(!va_is_mapped(blk));
+	assert(blk[0] == 0x22 && blk[BLKSIZE - 1] == 0x22);
+	if ((r = file_remove("/reuse")) < 0)
+		panic("file_remove /reuse: %e", r);
+	journal_request_done();
+	cprintf("journal block reuse is good\n");
+
+	// A file written a block at a time should still get one extent.
+	if ((r = file_create("/extent", &f)) < 0)
+		panic("file_create /extent: %e", r);
+	memset(bits, 0x5A, BLKSIZE);
+	for (i = 0; i < 2 * NDIRECT; i++) {
+		if ((r = file_write(f, bits, BLKSIZE, i * BLKSIZE)) != BLKSIZE)
+			panic("file_write /extent: %e", r);
+		journal_request_done();
+	}
+	for (i = 1; i < NDIRECT; i++)
+		assert(f->f_direct[i] == f->f_direct[0] + i);
+	file_flush(f);
+	cprintf("file extents are good\n");
+
+	// Read-ahead should bring in the extent with the file's dirty
+	// blocks written back and its data unchanged.
+	bc_drop();
+	file_readahead(f, 0, NDIRECT);
+	bc_readahead_wait();
+	for (i = 0; i < NDIRECT / 2; i++) {
+		assert(va_is_mapped(diskaddr(f->f_direct[i])));
+		assert(!va_is_dirty(diskaddr(f->f_direct[i])));
+	}
+	if ((r = file_get_block(f, NDIRECT / 2 - 1, &blk)) < 0)
+		panic("file_get_block /extent: %e", r);
+	assert(blk[0] == 0x5A && blk[BLKSIZE - 1] == 0x5A);
+
+	// Reading the extent sequentially, a block per request as a
+	// client would, should take few single-block reads: the rest
+	// arrive in multi-block read-ahead commands.
+	bc_drop();
+	memset(&ra, 0, sizeof(ra));
+	stats = bc_stats;
+	for (i = 0; i < 2 * NDIRECT; i++) {
+		if ((r = file_read(f, bits, BLKSIZE, i * BLKSIZE)) != BLKSIZE)
+			panic("file_read /extent: %e", r);
+		assert(bits[0] == 0x5A5A5A5A);
+		file_read_noted(f, &ra, i * BLKSIZE, BLKSIZE);
+		bc_readahead_poll();
+	}
+	assert(bc_stats.ra_cmds > stats.ra_cmds);
+	assert(bc_stats.ra_blocks - stats.ra_blocks
+	       >= 2 * (bc_stats.ra_cmds - stats.ra_cmds));
+	assert(bc_stats.misses - stats.misses < NDIRECT / 2);
+	if ((r = file_remove("/extent")) < 0)
+		panic("file_remove /extent: %e", r);
+	cprintf("file_readahead is good\n");
+
+	// Enough files to spread the root directory over several blocks,
+	// which gives it an index.
+	for (i = 0; i < 3 * BLKFILES; i++) {
+		snprintf(name, sizeof(name), "/dirindex%d", i);
+		if ((r = file_create(name, &f)) < 0)
+			panic("file_create %s: %e", name, r);
+		journal_request_done();
+	}
+	assert(super->s_root.f_hindex != 0);
+	for (i = 0; i < 3 * BLKFILES; i++) {
+		snprintf(name, sizeof(name), "/dirindex%d", i);
+		if ((r = file_open(name, &f)) < 0)
+			panic("file_open %s: %e", name, r);
+		assert(strcmp(f->f_name, name + 1) == 0);
+	}
+	if ((r = file_open("/newmotd", &f)) < 0)
+		panic("file_open /newmotd with index: %e", r);
+	for (i = 0; i < 3 * BLKFILES; i++) {
+		snprintf(name, sizeof(name), "/dirindex%d", i);
+		if ((r = file_remove(name)) < 0)
+			panic("file_remove %s: %e", name, r);
+		journal_request_done();
+		if ((r = file_open(name, &f)) != -E_NOT_FOUND)
+			panic("file_open removed %s: %e", name, r);
+	}
+	cprintf("directory index is good\n");
 }
@@ -0,0 +1,20 @@
+#ifndef JOS_INC_CRC_H
+#define JOS_INC_CRC_H
+
+#include <inc/types.h>
+
+// CRC-32C (Castagnoli), as used by iSCSI, ext4 and btrfs.  Pass 0 as
+// 'crc' to start; pass a previous result to continue a running CRC.
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
+// The two implementations crc32c picks between.  crc32c_hw needs SSE4.2;
+// check crc32c_hw_supported first.
+uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len);
+uint32_t crc32c_hw(uint32_t crc, const void *buf, size_t len);
+bool	crc32c_hw_supported(void);
+
+// The Internet checksum (RFC 1071) of 'buf', in the byte order in which
+// it is stored into a packet header.
+uint16_t inet_checksum(const void *buf, size_t len);
+
+#endif /* not JOS_INC_CRC_H */
@@ -41,8 +41,12 @@ enum {
 // Special environment types
 enum EnvType {
 	ENV_TYPE_USER = 0,
+	ENV_TYPE_FS,		// File system server
 };
 
+// Number of hardware performance counters virtualized per environment
+#define ENV_NPMC		4
+
 struct Env {
 	struct Trapframe env_tf;	// Saved registers
 	struct Env *env_link;		// Next free Env
@@ -54,6 +58,27 @@ struct Env {
 
 	// Address space
 	pde_t *env_pgdir;		// Kernel virtual address of page dir
+
+	// Exception handling
+	void *env_pgfault_upcall;	// Page fault upcall entry point
+
+	// Lab 4 IPC
+	bool env_ipc_recving;		// Env is blocked receiving
+	void *env_ipc_dstva;		// VA at which to map received page
+	uint32_t env_ipc_value;		// Data value sent to us
+	envid_t env_ipc_from;		// envid of the sender
+	int env_ipc_perm;		// Perm of page mapping received
+
+	// Hardware interrupt the env is blocked on, or -1
+	int env_irq_wait;
+	bool env_cons_wait;		// Env is blocked in sys_cgetc_wait
+
+	// Performance counters, counted only while this env runs
+	uint64_t env_pmc[ENV_NPMC];
+
+	// FPU/SSE state, saved with FXSAVE only when another env needs the FPU
+	bool env_fpu_used;		// Has the env touched the FPU yet?
+	uint8_t env_fpu[512] __attribute__((aligned(16)));
 };
 
 #endif // !JOS_INC_ENV_H
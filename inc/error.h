@@ -13,6 +13,16 @@ enum {
 	E_NO_FREE_ENV	,	// Attempt to create a new environment beyond
 				// the maximum allowed
 	E_FAULT		,	// Memory fault
+	E_NOT_FOUND	,	// File or program not found
+	E_NOT_EXEC	,	// File not a valid executable
+	E_IPC_NOT_RECV	,	// Attempt to send to env that is not recving
+
+	// File system error codes -- only seen in user-level
+	E_NO_DISK	,	// No free space left on disk
+	E_MAX_OPEN	,	// Too many files are open
+	E_BAD_PATH	,	// Bad path
+	E_FILE_EXISTS	,	// File already exists
+	E_NOT_SUPP	,	// Operation not supported
 
 	MAXERROR
 };
@@ -16,6 +16,9 @@
 #include <inc/env.h>
 #include <inc/memlayout.h>
 #include <inc/syscall.h>
+#include <inc/trap.h>
+#include <inc/fs.h>
+#include <inc/fd.h>
 
 #define USED(x)		(void)(x)
 
@@ -31,14 +34,60 @@ extern const volatile struct PageInfo pages[];
 // exit.c
 void	exit(void);
 
+// pgfault.c
+void	set_pgfault_handler(void (*handler)(struct UTrapframe *utf));
+
 // readline.c
 char*	readline(const char *buf);
 
 // syscall.c
 void	sys_cputs(const char *string, size_t len);
 int	sys_cgetc(void);
+int	sys_cgetc_wait(void);
 envid_t	sys_getenvid(void);
 int	sys_env_destroy(envid_t);
+void	sys_yield(void);
+envid_t	sys_spawn(const char *name, const char **argv);
+int	sys_env_set_pgfault_upcall(envid_t env, void *upcall);
+int	sys_page_alloc(envid_t env, void *pg, int perm);
+int	sys_page_map(envid_t src_env, void *src_pg,
+		     envid_t dst_env, void *dst_pg, int perm);
+int	sys_page_unmap(envid_t env, void *pg);
+int	sys_ipc_try_send(envid_t to_env, uint32_t value, void *pg, int perm);
+int	sys_ipc_recv(void *rcv_pg);
+int	sys_irq_wait(int irq);
+
+// ipc.c
+void	ipc_send(envid_t to_env, uint32_t value, void *pg, int perm);
+int32_t ipc_recv(envid_t *from_env_store, void *pg, int *perm_store);
+envid_t	ipc_find_env(enum EnvType type);
+
+// fd.c
+int	close(int fd);
+ssize_t	read(int fd, void *buf, size_t nbytes);
+ssize_t	write(int fd, const void *buf, size_t nbytes);
+int	seek(int fd, off_t offset);
+void	close_all(void);
+ssize_t	readn(int fd, void *buf, size_t nbytes);
+int	fstat(int fd, struct Stat *statbuf);
+int	stat(const char *path, struct Stat *statbuf);
+int	ftruncate(int fd, off_t size);
+
+// file.c
+int	open(const char *path, int mode);
+int	remove(const char *path);
+int	sync(void);
+int	drop_caches(void);
+
+// mmap.c
+int	mmap(void *addr, size_t len, int flags, int fd, off_t offset);
+int	munmap(void *addr, size_t len);
+
+// pageref.c
+int	pageref(void *addr);
+
+// Pages mapped with PTE_SHARE are shared between envs, not copied.
+#define PTE_SHARE	0x400
 
 
 
@@ -53,4 +102,8 @@ int	sys_env_destroy(envid_t);
 #define	O_EXCL		0x0400		/* error if already exists */
 #define O_MKDIR		0x0800		/* create directory, not regular file */
 
+/* mmap flags */
+#define	MAP_SHARED	0x0000		/* share the file's pages, read-only */
+#define	MAP_PRIVATE	0x0001		/* copy a page the first time it is written */
+
 #endif	// !JOS_INC_LIB_H
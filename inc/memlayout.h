@@ -55,10 +55,14 @@
  * UXSTACKTOP -/       |     User Exception Stack     | RW/RW  PGSIZE
  *                     +------------------------------+ 0xeebff000
  *                     |       Empty Memory (*)       | --/--  PGSIZE
- *    USTACKTOP  --->  +------------------------------+ 0xeebfe000
- *                     |      Normal User Stack       | RW/RW  PGSIZE
- *                     +------------------------------+ 0xeebfd000
- *                     |                              |
+ *    USTACKTOP  --->  +------------------------------+ 0xeebfe000      --+
+ *                     |      Normal User Stack       | RW/RW  PGSIZE     |
+ *                     + - - - - - - - - - - - - - - -+ 0xeebfd000        |
+ *                     |   Stack Growth Region (**)   | RW/RW          USTACKSIZE
+ *                     |                              |                   |
+ *    USTACKBOT  --->  +------------------------------+ 0xeeafe000      --+
+ *                     |    Stack Guard Page (*)      | --/--  PGSIZE
+ *                     +------------------------------+ 0xeeafd000
  *                     |                              |
  *                     ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
  *                     .                              .
@@ -80,6 +84,11 @@
  * (*) Note: The kernel ensures that "Invalid Memory" is *never* mapped.
  *     "Empty Memory" is normally unmapped, but user programs may map pages
  *     there if desired.  JOS user programs map pages temporarily at UTEMP.
+ *     The stack guard page is never mapped by the kernel, so a stack that
+ *     runs past USTACKBOT faults there and the env is destroyed.
+ * (**) Only the top stack page is mapped when an env starts.  The page
+ *     fault handler maps zeroed pages in the rest of [USTACKBOT, USTACKTOP)
+ *     as the stack grows into them.
  */
 
 #define KERNELADDR      0x100000
@@ -128,6 +137,10 @@
 // Next page left invalid to guard against exception stack overflow; then:
 // Top of normal user stack
 #define USTACKTOP	(UTOP - 2*PGSIZE)
+// Most the normal user stack may grow to, mapped on demand
+#define USTACKSIZE	(256*PGSIZE)
+// Bottom of normal user stack; the page below it is a guard page
+#define USTACKBOT	(USTACKTOP - USTACKSIZE)
 
 // Where user programs generally begin
 #define UTEXT		(2*PTSIZE)
@@ -7,6 +7,16 @@ enum {
 	SYS_cgetc,
 	SYS_getenvid,
 	SYS_env_destroy,
+	SYS_yield,
+	SYS_spawn,
+	SYS_page_alloc,
+	SYS_page_map,
+	SYS_page_unmap,
+	SYS_env_set_pgfault_upcall,
+	SYS_ipc_try_send,
+	SYS_ipc_recv,
+	SYS_irq_wait,
+	SYS_cgetc_wait,
 	NSYSCALLS
 };
 
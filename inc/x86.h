@@ -248,6 +248,30 @@ read_tsc(void)
 	return tsc;
 }
 
+static inline uint64_t
+rdmsr(uint32_t msr)
+{
+	uint64_t val;
+	asm volatile("rdmsr" : "=A" (val) : "c" (msr));
+	return val;
+}
+
+static inline void
+wrmsr(uint32_t msr, uint64_t val)
+{
+	asm volatile("wrmsr" : : "c" (msr), "A" (val));
+}
+
+// Read performance counter 'ctr'.  User mode may use this only if the
+// kernel set CR4_PCE.
+static inline uint64_t
+rdpmc(uint32_t ctr)
+{
+	uint64_t val;
+	asm volatile("rdpmc" : "=A" (val) : "c" (ctr));
+	return val;
+}
+
 static inline uint32_t
 xchg(volatile uint32_t *addr, uint32_t newval)
 {
@@ -5,11 +5,13 @@
 #include <inc/kbdreg.h>
 #include <inc/string.h>
 #include <inc/assert.h>
+#include <inc/trap.h>
 
 #include <kern/console.h>
+#include <kern/picirq.h>
+#include <kern/klog.h>
 
 static void cons_intr(int (*proc)(void));
-static void cons_putc(int c);
 
 // Stupid I/O delay routine necessitated by historical PC design flaws
 static void
@@ -62,17 +64,23 @@ serial_intr(void)
 		cons_intr(serial_proc_data);
 }
 
-static void
-serial_putc(int c)
+// Send a character, waiting for the transmitter only if 'wait' is set.
+// Returns 0 on success, < 0 if the transmitter is still busy.
+int
+serial_putc(int c, bool wait)
 {
 	int i;
 
 	for (i = 0;
 	     !(inb(COM1 + COM_LSR) & COM_LSR_TXRDY) && i < 12800;
-	     i++)
+	     i++) {
+		if (!wait)
+			return -1;
 		delay();
+	}
 
 	outb(COM1 + COM_TX, c);
+	return 0;
 }
 
 static void
@@ -89,8 +97,8 @@ serial_init(void)
 	// 8 data bits, 1 stop bit, parity off; turn off DLAB latch
 	outb(COM1+COM_LCR, COM_LCR_WLEN8 & ~COM_LCR_DLAB);
 
-	// No modem controls
-	outb(COM1+COM_MCR, 0);
+	// No modem controls; OUT2 gates the UART's interrupt line
+	outb(COM1+COM_MCR, COM_MCR_OUT2);
 	// Enable rcv interrupts
 	outb(COM1+COM_IER, COM_IER_RDI);
 
@@ -100,6 +108,8 @@ serial_init(void)
 	(void) inb(COM1+COM_IIR);
 	(void) inb(COM1+COM_RX);
 
+	if (serial_exists)
+		irq_enable(IRQ_SERIAL);
 }
 
 
@@ -108,16 +118,22 @@ serial_init(void)
 // For information on PC parallel port programming, see the class References
 // page.
 
-static void
-lpt_putc(int c)
+// Like serial_putc, but for the printer.  With no printer attached the
+// port stays busy, so even a waiting caller gives up and gets < 0.
+int
+lpt_putc(int c, bool wait)
 {
 	int i;
 
-	for (i = 0; !(inb(0x378+1) & 0x80) && i < 12800; i++)
+	for (i = 0; !(inb(0x378+1) & 0x80); i++) {
+		if (!wait || i == 12800)
+			return -1;
 		delay();
+	}
 	outb(0x378+0, c);
 	outb(0x378+2, 0x08|0x04|0x01);
 	outb(0x378+2, 0x08);
+	return 0;
 }
 
 
@@ -127,7 +143,10 @@ lpt_putc(int c)
 
 static unsigned addr_6845;
 static uint16_t *crt_buf;
-static uint16_t crt_pos;
+static uint16_t crt_pos;	// cursor, relative to the top of the screen
+static uint16_t crt_origin;	// cell shown at the top-left of the screen
+static uint16_t crt_bufsize;	// cells of display memory we may scroll over
+static bool crt_stale;		// CRTC registers lag crt_pos/crt_origin
 
 static void
 cga_init(void)
@@ -142,9 +161,12 @@ cga_init(void)
 	if (*cp != 0xA55A) {
 		cp = (uint16_t*) (KERNBASE + MONO_BUF);
 		addr_6845 = MONO_BASE;
+		// An MDA card only has one screen of memory.
+		crt_bufsize = CRT_SIZE;
 	} else {
 		*cp = was;
 		addr_6845 = CGA_BASE;
+		crt_bufsize = CGA_BUFSIZE / sizeof(uint16_t);
 	}
 
 	/* Extract cursor location */
@@ -154,12 +176,61 @@ cga_init(void)
 	pos |= inb(addr_6845 + 1);
 
 	crt_buf = (uint16_t*) cp;
-	crt_pos = pos;
+	crt_pos = pos < CRT_SIZE ? pos : 0;
+	crt_origin = 0;
+	crt_stale = true;
+	cga_sync();
+}
+
+// Scroll the screen up one line.  Normally this just moves the CRTC's
+// start address down a row in display memory; only when the screen
+// reaches the end of display memory is it copied back to the start.
+static void
+cga_scroll(void)
+{
+	int i;
+
+	if (crt_origin + CRT_SIZE + CRT_COLS > crt_bufsize) {
+		memmove(crt_buf, crt_buf + crt_origin + CRT_COLS,
+			(CRT_SIZE - CRT_COLS) * sizeof(uint16_t));
+		crt_origin = 0;
+	} else
+		crt_origin += CRT_COLS;
+	for (i = CRT_SIZE - CRT_COLS; i < CRT_SIZE; i++)
+		crt_buf[crt_origin + i] = 0x0700 | ' ';
+	crt_pos -= CRT_COLS;
 }
 
+// Bring the CRTC's start address and cursor up to date.  cga_putc
+// leaves this to the end of each batch of output, since every
+// register write is a slow I/O port access.
+void
+cga_sync(void)
+{
+	unsigned cursor = crt_origin + crt_pos;
+
+	if (!crt_stale)
+		return;
+	outb(addr_6845, 12);
+	outb(addr_6845 + 1, crt_origin >> 8);
+	outb(addr_6845, 13);
+	outb(addr_6845 + 1, crt_origin);
+
+	/* move that little blinky thing */
+	outb(addr_6845, 14);
+	outb(addr_6845 + 1, cursor >> 8);
+	outb(addr_6845, 15);
+	outb(addr_6845 + 1, cursor);
+	crt_stale = false;
+}
 
+// The display is always ready, so this never fails; 'wait' is only
+// there to match serial_putc.
+int
+cga_putc(int c, bool wait)
+{
+	int i;
 
-static void cga_putc(int c) {
 	// if no attribute given, then use black on white
 	if (!(c & ~0xFF))
 		c |= 0x0700;
@@ -168,7 +239,7 @@ static void cga_putc(int c) {
 	case '\b':
 		if (crt_pos > 0) {
 			crt_pos--;
-			crt_buf[crt_pos] = (c & ~0xff) | ' ';
+			crt_buf[crt_origin + crt_pos] = (c & ~0xff) | ' ';
 		}
 		break;
 	case '\n':
@@ -178,32 +249,18 @@ static void cga_putc(int c) {
 		crt_pos -= (crt_pos % CRT_COLS);
 		break;
 	case '\t':
-		cons_putc(' ');
-		cons_putc(' ');
-		cons_putc(' ');
-		cons_putc(' ');
-		cons_putc(' ');
-		break;
+		for (i = 0; i < 5; i++)
+			cga_putc(' ', wait);
+		return 0;
 	default:
-		crt_buf[crt_pos++] = c;		/* write the character */
+		crt_buf[crt_origin + crt_pos++] = c;	/* write the character */
 		break;
 	}
 
-	// What is the purpose of this?
-	if (crt_pos >= CRT_SIZE) {
-		int i;
-
-		memmove(crt_buf, crt_buf + CRT_COLS, (CRT_SIZE - CRT_COLS) * sizeof(uint16_t));
-		for (i = CRT_SIZE - CRT_COLS; i < CRT_SIZE; i++)
-			crt_buf[i] = 0x0700 | ' ';
-		crt_pos -= CRT_COLS;
-	}
-
-	/* move that little blinky thing */
-	outb(addr_6845, 14);
-	outb(addr_6845 + 1, crt_pos >> 8);
-	outb(addr_6845, 15);
-	outb(addr_6845 + 1, crt_pos);
+	if (crt_pos >= CRT_SIZE)
+		cga_scroll();
+	crt_stale = true;
+	return 0;
 }
 
 
@@ -371,6 +428,9 @@ kbd_intr(void)
 static void
 kbd_init(void)
 {
+	// Drain the keyboard buffer so that QEMU generates interrupts.
+	kbd_intr();
+	irq_enable(IRQ_KBD);
 }
 
 
@@ -426,15 +486,6 @@ cons_getc(void)
 	return 0;
 }
 
-// output a character to the console
-static void
-cons_putc(int c)
-{
-	serial_putc(c);
-	lpt_putc(c);
-	cga_putc(c);
-}
-
 // initialize the console devices
 void
 cons_init(void)
@@ -453,7 +504,8 @@ cons_init(void)
 void
 cputchar(int c)
 {
-	cons_putc(c);
+	klog_putc(KLOG_INFO, c);
+	klog_drain();
 }
 
 int
@@ -462,7 +514,7 @@ getchar(void)
 	int c;
 
 	while ((c = cons_getc()) == 0)
-		/* do nothing */;
+		klog_drain();
 	return c;
 }
 
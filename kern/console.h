@@ -12,6 +12,7 @@
 #define MONO_BUF	0xB0000
 #define CGA_BASE	0x3D4
 #define CGA_BUF		0xB8000
+#define CGA_BUFSIZE	0x8000
 
 #define CRT_ROWS	25
 #define CRT_COLS	80
@@ -23,4 +24,10 @@ int cons_getc(void);
 void kbd_intr(void); // irq 1
 void serial_intr(void); // irq 4
 
+// Output devices, used as kernel log sinks.
+int serial_putc(int c, bool wait);
+int lpt_putc(int c, bool wait);
+int cga_putc(int c, bool wait);
+void cga_sync(void);
+
 #endif /* _CONSOLE_H_ */
@@ -11,6 +11,9 @@
 #include <kern/pmap.h>
 #include <kern/trap.h>
 #include <kern/monitor.h>
+#include <kern/sched.h>
+#include <kern/pmu.h>
+#include <kern/fpu.h>
 
 struct Env *envs = NULL;		// All environments
 struct Env *curenv = NULL;		// The current env
@@ -116,10 +119,9 @@ env_init(void)
 {
 	// Set up envs array
         for (int i = NENV - 1; i >= 0; i--) {
-            struct Env env = (struct Env)envs[i];
-            env.env_status = ENV_FREE;
-            env.env_id = 0;
-            env.env_link = env_free_list;
+            envs[i].env_status = ENV_FREE;
+            envs[i].env_id = 0;
+            envs[i].env_link = env_free_list;
             env_free_list = &envs[i];
         }
 
@@ -148,6 +150,13 @@ env_init_percpu(void)
 	lldt(0);
 }
 
+// Recycled page directories, ready for reuse by env_setup_vm.
+// Each one has its kernel half (and its UVPT self-mapping) already
+// set up, and an empty user half, since env_free leaves it that way.
+static pde_t *pgdir_cache[ENV_PGDIR_CACHE_SIZE];
+static int pgdir_cache_len;
+struct PgdirCacheStats pgdir_cache_stats = { ENV_PGDIR_CACHE_SIZE };
+
 //
 // Initialize the kernel virtual memory layout for environment e.
 // Allocate a page directory, set e->env_pgdir accordingly,
@@ -155,64 +164,44 @@ env_init_percpu(void)
 // Do NOT (yet) map anything into the user portion
 // of the environment's virtual address space.
 //
+// A page directory released by env_free is reused when one is cached,
+// which skips both the allocation and the initialization below.
+//
 // Returns 0 on success, < 0 on error.  Errors include:
 //	-E_NO_MEM if page directory or table could not be allocated.
 //
 static int
 env_setup_vm(struct Env *e)
 {
-	int i;
 	struct PageInfo *p = NULL;
 
+	if (pgdir_cache_len > 0) {
+		e->env_pgdir = pgdir_cache[--pgdir_cache_len];
+		pgdir_cache_stats.hits++;
+		pgdir_cache_stats.len = pgdir_cache_len;
+		return 0;
+	}
+	pgdir_cache_stats.misses++;
+
 	// Allocate a page for the page directory
 	if (!(p = page_alloc(ALLOC_ZERO)))
-            return -E_NO_MEM;
+		return -E_NO_MEM;
 
 	// Now, set e->env_pgdir and initialize the page directory.
 	//
-	// Hint:
-	//    - The VA space of all envs is identical above UTOP
-	//	(except at UVPT, which we've set below).
-	//	See inc/memlayout.h for permissions and layout.
-	//	Can you use kern_pgdir as a template?  Hint: Yes.
-	//	(Make sure you got the permissions right in Lab 2.)
-	//    - The initial VA below UTOP is empty.
-	//    - You do not need to make any more calls to page_alloc.
-	//    - Note: In general, pp_ref is not maintained for
-	//	physical pages mapped only above UTOP, but env_pgdir
-	//	is an exception -- you need to increment env_pgdir's
-	//	pp_ref for env_free to work correctly.
-	//    - The functions in kern/pmap.h are handy.
-        p->pp_ref++;
-        e->env_pgdir = page2kva(p);
-
-        int page_list_size = ROUNDUP(npages * sizeof(struct PageInfo), PGSIZE);
-        int envs_size = ROUNDUP(NENV * sizeof(struct Env), PGSIZE);
-
-        physaddr_t pa_envs;
-        for (int i = 0; i < envs_size; i += PGSIZE) {
-            pa_envs = PADDR(envs) + i;
-            *pgdir_walk(e->env_pgdir, (void *)(UENVS + i), PTE_P | PTE_U) = pa_envs | PTE_P | PTE_U;
-            *pgdir_walk(e->env_pgdir, (void *)(envs + i), PTE_P | PTE_W) = pa_envs | PTE_P | PTE_W;
-        }
-
-        // XXX: not sure I'm mapping the memory it wants!
-        for (int i = 0; i < KSTKSIZE; i += PGSIZE)
-            *pgdir_walk(e->env_pgdir, (void *)(KSTACKTOP - KSTKSIZE + i), PTE_P | PTE_W) = (PADDR(bootstack) + i)
- | PTE_P | PTE_W;
-
-        const uint32_t CONST_2_TO_32 = 0xffffffff; // 2^32 - 1
-        physaddr_t pa;
-        // XXX: this is extremely hacky. When it wraps around, at 2^32, we want to catch it and stop.
-        for (void *va = (void *)KERNBASE; ROUNDUP(va, PGSIZE) != (void *)0; va += PGSIZE) {
-        //for (void *va = (void *)KERNBASE; va < (void *)ROUNDUP(CONST_2_TO_32, PGSIZE); va += PGSIZE) {
-            pa = PADDR(va);
-            assert(pa % PGSIZE == 0);
-
-            pte_t *pte = pgdir_walk(e->env_pgdir, va, PTE_P | PTE_W);
-            assert(pte);
-            *pte = pa | PTE_P | PTE_W;
-        }
+	// The VA space of all envs is identical above UTOP (except at
+	// UVPT, which we set below), so the kernel half is shared with
+	// kern_pgdir: copy its page directory entries, which point at
+	// the kernel's own page tables.  The initial VA below UTOP is
+	// empty, which page_alloc(ALLOC_ZERO) already gave us.
+	//
+	// In general, pp_ref is not maintained for physical pages mapped
+	// only above UTOP, but env_pgdir is an exception -- env_free
+	// needs it to release the page directory.
+	p->pp_ref++;
+	e->env_pgdir = page2kva(p);
+	memcpy(&e->env_pgdir[PDX(UTOP)], &kern_pgdir[PDX(UTOP)],
+	       (NPDENTRIES - PDX(UTOP)) * sizeof(pde_t));
 
 	// UVPT maps the env's own page table read-only.
 	// Permissions: kernel R, user R
@@ -221,6 +210,21 @@ env_setup_vm(struct Env *e)
 	return 0;
 }
 
+//
+// Release a page directory whose user half has already been emptied.
+// It is kept in pgdir_cache for the next env_setup_vm if there is room.
+//
+static void
+env_release_vm(pde_t *pgdir)
+{
+	if (pgdir_cache_len < ENV_PGDIR_CACHE_SIZE) {
+		pgdir_cache[pgdir_cache_len++] = pgdir;
+		pgdir_cache_stats.len = pgdir_cache_len;
+		return;
+	}
+	page_decref(pa2page(PADDR(pgdir)));
+}
+
 //
 // Allocates and initializes a new environment.
 // On success, the new environment is stored in *newenv_store.
@@ -277,124 +281,225 @@ env_alloc(struct Env **newenv_store, envid_t parent_id)
 	e->env_tf.tf_cs = GD_UT | 3;
 	// You will set e->env_tf.tf_eip later.
 
+	// Enable interrupts while in user mode.
+	e->env_tf.tf_eflags |= FL_IF;
+
+	// Clear the page fault handler until user installs one.
+	e->env_pgfault_upcall = 0;
+
+	// Start counting events from zero.
+	memset(e->env_pmc, 0, sizeof(e->env_pmc));
+
+	// The FPU is initialized on first use.
+	e->env_fpu_used = 0;
+
+	// Not waiting for an IPC, an interrupt, or console input.
+	e->env_ipc_recving = 0;
+	e->env_irq_wait = -1;
+	e->env_cons_wait = 0;
+
 	// commit the allocation
 	env_free_list = e->env_link;
 	*newenv_store = e;
 
+	cprintf("[%08x] new env %08x\n", curenv ? curenv->env_id : 0, e->env_id);
+
 	return 0;
 }
 
 //
 // Allocate len bytes of physical memory for environment env,
 // and map it at virtual address va in the environment's address space.
-// Does not zero or otherwise initialize the mapped pages in any way.
+// 'va' and 'len' need not be page-aligned.  Pages that are already
+// mapped are left alone; newly allocated pages are zeroed.
 // Pages should be writable by user and kernel.
-// Panic if any allocation attempt fails.
 //
-static void
+// Returns 0 on success, -E_NO_MEM if any allocation attempt fails.
+// Pages mapped before the failure stay mapped; env_free releases them.
+//
+static int
 region_alloc(struct Env *e, void *va, size_t len)
 {
-	// LAB 3: Your code here.
-	// (But only if you need it for load_icode.)
-	//
-	// Hint: It is easier to use region_alloc if the caller can pass
-	//   'va' and 'len' values that are not page-aligned.
-	//   You should round va down, and round (va + len) up.
-	//   (Watch out for corner-cases!)
-        for (void *addr = ROUNDDOWN(va, PGSIZE); addr < ROUNDDOWN(va, PGSIZE) + ROUNDUP(len, PGSIZE); addr += PGSIZE) {
-            struct PageInfo *pp = page_alloc(0);
-            //cprintf("\tva: %p, addr: %p, pp: %p, e: %p, e->env_pgdir: %p\n", va, addr, pp, e, e->env_pgdir);
-            int retval = page_insert(e->env_pgdir, pp, addr, PTE_P | PTE_W | PTE_U);
-            if (retval < 0) panic("Failed to insert page: %e", retval);
-        }
+	uintptr_t addr, end;
+	struct PageInfo *pp;
+	pte_t *pte;
+	int r;
+
+	end = ROUNDUP((uintptr_t) va + len, PGSIZE);
+	for (addr = ROUNDDOWN((uintptr_t) va, PGSIZE); addr < end; addr += PGSIZE) {
+		pte = pgdir_walk(e->env_pgdir, (void *) addr, 0);
+		if (pte && (*pte & PTE_P))
+			continue;
+		if (!(pp = page_alloc(ALLOC_ZERO)))
+			return -E_NO_MEM;
+		if ((r = page_insert(e->env_pgdir, pp, (void *) addr,
+				     PTE_P | PTE_W | PTE_U)) < 0) {
+			page_free(pp);
+			return r;
+		}
+	}
+	return 0;
+}
+
+//
+// Copy len bytes from kernel memory at src to user virtual address va
+// in environment e, which must already be mapped (e.g. by region_alloc).
+// The copy goes through the kernel's mapping of each physical page,
+// so e's page directory does not need to be loaded.
+//
+static void
+region_copyout(struct Env *e, uintptr_t va, const void *src, size_t len)
+{
+	size_t n;
+	pte_t *pte;
+
+	while (len > 0) {
+		pte = pgdir_walk(e->env_pgdir, (void *) va, 0);
+		assert(pte && (*pte & PTE_P));
+		n = MIN(len, PGSIZE - PGOFF(va));
+		memcpy((uint8_t *) KADDR(PTE_ADDR(*pte)) + PGOFF(va), src, n);
+		va += n;
+		src = (const uint8_t *) src + n;
+		len -= n;
+	}
 }
 
 //
 // Set up the initial program binary, stack, and processor flags
 // for a user process.
-// This function is ONLY called during kernel initialization,
-// before running the first user-mode environment.
 //
 // This function loads all loadable segments from the ELF binary image
-// into the environment's user memory, starting at the appropriate
-// virtual addresses indicated in the ELF program header.
-// At the same time it clears to zero any portions of these segments
-// that are marked in the program header as being mapped
-// but not actually present in the ELF file - i.e., the program's bss section.
+// of 'size' bytes into the environment's user memory, starting at the
+// appropriate virtual addresses indicated in the ELF program header.
+// Portions of these segments that are marked in the program header as
+// being mapped but not actually present in the ELF file - i.e., the
+// program's bss section - are zero.
 //
 // All this is very similar to what our boot loader does, except the boot
-// loader also needs to read the code from disk.  Take a look at
-// boot/main.c to get ideas.
+// loader also needs to read the code from disk.
 //
 // Finally, this function maps one page for the program's initial stack.
 //
-// load_icode panics if it encounters problems.
-//  - How might load_icode fail?  What might be wrong with the given input?
+// The image is checked before anything is trusted: the ELF header,
+// program headers and segment contents must all lie inside the image,
+// and every segment must fit below UTOP.
 //
-static void
-load_icode(struct Env *e, uint8_t *binary)
+// Returns 0 on success, < 0 on error.  Errors include:
+//	-E_NOT_EXEC if the image is not a valid ELF executable
+//	-E_NO_MEM on memory exhaustion
+// On error the env may be partially populated; the caller frees it.
+//
+static int
+load_icode(struct Env *e, uint8_t *binary, size_t size)
 {
-	// Hints:
-	//  Load each program segment into virtual memory
-	//  at the address specified in the ELF segment header.
-	//  You should only load segments with ph->p_type == ELF_PROG_LOAD.
-	//  Each segment's virtual address can be found in ph->p_va
-	//  and its size in memory can be found in ph->p_memsz.
-	//  The ph->p_filesz bytes from the ELF binary, starting at
-	//  'binary + ph->p_offset', should be copied to virtual address
-	//  ph->p_va.  Any remaining memory bytes should be cleared to zero.
-	//  (The ELF header should have ph->p_filesz <= ph->p_memsz.)
-	//  Use functions from the previous lab to allocate and map pages.
-	//
-	//  All page protection bits should be user read/write for now.
-	//  ELF segments are not necessarily page-aligned, but you can
-	//  assume for this function that no two segments will touch
-	//  the same virtual page.
-	//
-	//  You may find a function like region_alloc useful.
-	//
-	//  Loading the segments is much simpler if you can move data
-	//  directly into the virtual addresses stored in the ELF binary.
-	//  So which page directory should be in force during
-	//  this function?
-	//
-	//  You must also do something with the program's entry point,
-	//  to make sure that the environment starts executing there.
-	//  What?  (See env_run() and env_pop_tf() below.)
-
-        lcr3(PADDR(e->env_pgdir));
-
-        struct Elf *elf = (struct Elf *)binary;
+	struct Elf *elf = (struct Elf *) binary;
+	struct Proghdr *ph, *eph;
+	int r;
 
-        if (elf->e_magic != ELF_MAGIC)
-            panic("Program is not valid ELF");
+	if (size < sizeof(struct Elf) || elf->e_magic != ELF_MAGIC)
+		return -E_NOT_EXEC;
+	if (elf->e_phoff > size
+	    || elf->e_phnum > (size - elf->e_phoff) / sizeof(struct Proghdr))
+		return -E_NOT_EXEC;
+	if (elf->e_entry >= UTOP)
+		return -E_NOT_EXEC;
+
+	ph = (struct Proghdr *) (binary + elf->e_phoff);
+	eph = ph + elf->e_phnum;
+	for (; ph < eph; ph++) {
+		if (ph->p_type != ELF_PROG_LOAD)
+			continue;
+		if (ph->p_filesz > ph->p_memsz
+		    || ph->p_offset > size
+		    || ph->p_filesz > size - ph->p_offset
+		    || ph->p_va >= UTOP
+		    || ph->p_memsz > UTOP - ph->p_va)
+			return -E_NOT_EXEC;
+
+		if ((r = region_alloc(e, (void *) ph->p_va, ph->p_memsz)) < 0)
+			return r;
+		region_copyout(e, ph->p_va, binary + ph->p_offset, ph->p_filesz);
+	}
 
-        struct Proghdr *ph = (struct Proghdr *) ((uint8_t *) binary + elf->e_phoff);
-        void *eph = ph + elf->e_phnum;
-        for (; (void *)ph < eph; ph++) {
-            region_alloc(e, (void *)(ph->p_va), ph->p_memsz);
-            memset((void *)(ph->p_va), 0, ph->p_memsz);
+	// Now map one page for the program's initial stack
+	// at virtual address USTACKTOP - PGSIZE.
+	if ((r = region_alloc(e, (void *) (USTACKTOP - PGSIZE), PGSIZE)) < 0)
+		return r;
 
-            if (ph->p_type != ELF_PROG_LOAD) continue;
-            //cprintf("deets:\n\tph->p_va: %p\n\tph->p_offset: %p\n\tbinary: %p\n\tph->p_filesz: %p\n", ph->p_va, ph->p_offset, binary, ph->p_filesz);
-            assert(ph->p_filesz <= ph->p_memsz);
-            memcpy((void *)(ph->p_va), (void *)(binary + ph->p_offset), ph->p_filesz);
-            cprintf("ph->p_va=%p, entry=%p\n", (ph->p_va), (elf->e_entry));
-        }
+	e->env_tf.tf_eip = elf->e_entry;
+	return 0;
+}
 
-        lcr3(PADDR(kern_pgdir));
+//
+// Lay out the argument vector 'argv' (a NULL-terminated array of
+// kernel strings) on e's initial stack page, and point e's stack
+// pointer at it.  The resulting stack looks like the frame of a call
+// to libmain(argc, argv), which lib/entry.S makes:
+//
+//	USTACKTOP ->	argument strings
+//			argv[argc] = NULL  (word aligned)
+//			argv[argc - 1] ... argv[0]
+//			argv  (pointer to argv[0])
+//	tf_esp ->	argc
+//
+// Everything is written through the kernel's mapping of the stack page,
+// so e's page directory does not need to be loaded.
+//
+// Returns 0 on success, -E_INVAL if the arguments do not fit in the
+// initial stack page.
+//
+static int
+env_setup_args(struct Env *e, const char **argv)
+{
+	uintptr_t stack_va = USTACKTOP - PGSIZE;
+	size_t string_size = 0, len;
+	uint8_t *stack;
+	uint32_t *sp, *uargv;
+	char *strings;
+	pte_t *pte;
+	int argc, i;
+
+	for (argc = 0; argv[argc]; argc++)
+		string_size += strlen(argv[argc]) + 1;
+	if (string_size + (argc + 3) * sizeof(uint32_t) + sizeof(uint32_t) > PGSIZE)
+		return -E_INVAL;
+
+	pte = pgdir_walk(e->env_pgdir, (void *) stack_va, 0);
+	assert(pte && (*pte & PTE_P));
+	stack = KADDR(PTE_ADDR(*pte));
+
+	// Translate a pointer into 'stack' to e's view of that address.
+#define STACK_UVA(p)	(stack_va + ((uint8_t *) (p) - stack))
+
+	strings = (char *) stack + PGSIZE - string_size;
+	uargv = (uint32_t *) ROUNDDOWN(strings, sizeof(uint32_t)) - (argc + 1);
+	for (i = 0; i < argc; i++) {
+		len = strlen(argv[i]) + 1;
+		memcpy(strings, argv[i], len);
+		uargv[i] = STACK_UVA(strings);
+		strings += len;
+	}
+	uargv[argc] = 0;
 
-	// Now map one page for the program's initial stack
-	// at virtual address USTACKTOP - PGSIZE.
+	sp = uargv - 2;
+	sp[0] = argc;
+	sp[1] = STACK_UVA(uargv);
+	e->env_tf.tf_esp = STACK_UVA(sp);
 
-        struct PageInfo *pp = page_alloc(ALLOC_ZERO);
-        int retval = page_insert(e->env_pgdir, pp, (void *)(USTACKTOP - PGSIZE), PTE_P | PTE_W | PTE_U);
-        if (retval) {
-            panic("page_insert failed: %d", retval);
-        }
+#undef STACK_UVA
+	return 0;
+}
 
-        e->env_tf.tf_eip = elf->e_entry;
-        cprintf("e->env_tf.tf_eip: %p\n", e->env_tf.tf_eip);
+//
+// Make e a special environment of the given type.  The file system
+// server drives the disk itself, so it gets the I/O ports.
+//
+static void
+env_set_type(struct Env *e, enum EnvType type)
+{
+	e->env_type = type;
+	if (type == ENV_TYPE_FS)
+		e->env_tf.tf_eflags |= FL_IOPL_3;
 }
 
 //
@@ -405,16 +510,107 @@ load_icode(struct Env *e, uint8_t *binary)
 // The new env's parent ID is set to 0.
 //
 void
-env_create(uint8_t *binary, enum EnvType type)
+env_create(uint8_t *binary, size_t size, enum EnvType type)
+{
+	struct Env *e;
+	int r;
+
+	if ((r = env_alloc(&e, 0)) < 0)
+		panic("env_create: env_alloc: %e", r);
+	if ((r = load_icode(e, binary, size)) < 0)
+		panic("env_create: load_icode: %e", r);
+	env_set_type(e, type);
+}
+
+//
+// Find the user program image named 'name' among the binaries
+// linked into the kernel.  'name' is either the image's full path
+// under obj/ (e.g. "user/hello") or just its last component ("hello").
+//
+// Returns NULL if there is no such image.
+//
+const struct EmbeddedBinary *
+embedded_binary_lookup(const char *name)
+{
+	const struct EmbeddedBinary *b;
+	const char *base;
+
+	for (b = embedded_binaries; b < embedded_binaries + nembedded_binaries; b++) {
+		base = strfind(b->name, '/');
+		base = *base ? base + 1 : b->name;
+		if (strcmp(name, b->name) == 0 || strcmp(name, base) == 0)
+			return b;
+	}
+	return NULL;
+}
+
+// Embedded programs that run as special environments.  There is at most
+// one of each; they are started by the first env that spawns them.
+static const struct {
+	const char *name;
+	enum EnvType type;
+} system_envs[] = {
+	{ "fs/fs", ENV_TYPE_FS },
+};
+
+//
+// Create a new user environment running the embedded program 'name',
+// as a child of parent_id.  Unlike env_create, this may be called at
+// any time and reports failures instead of panicking.
+//
+// If 'name' is one of the system_envs, the new env gets that type and
+// has no parent.  If such an env is already running, it is returned
+// instead of starting a second one.
+//
+// If argv is not NULL, it is a NULL-terminated array of kernel strings
+// that the program receives as umain's argc and argv.  By convention
+// argv[0] is the program name.
+//
+// Returns 0 on success and stores the new env in *newenv_store,
+// < 0 on error.  Errors include:
+//	-E_NOT_FOUND if there is no embedded program called 'name'
+//	-E_NOT_EXEC if the program image is not a valid executable
+//	-E_INVAL if the arguments do not fit on the initial stack
+//	-E_NO_FREE_ENV if all NENV environments are allocated
+//	-E_NO_MEM on memory exhaustion
+//
+int
+env_spawn(const char *name, const char **argv, envid_t parent_id,
+	  struct Env **newenv_store)
 {
-    struct Env *e;
-    int err;
-    if ((err = env_alloc((struct Env **) &e, 0))) {
-        panic("Failed to env_alloc(): %e", err);
-    }
-
-    load_icode((struct Env *)e, binary);
-    e->env_type = type;
+	const struct EmbeddedBinary *b;
+	enum EnvType type = ENV_TYPE_USER;
+	struct Env *e;
+	int i, r;
+
+	if (!(b = embedded_binary_lookup(name)))
+		return -E_NOT_FOUND;
+
+	for (i = 0; i < ARRAY_SIZE(system_envs); i++)
+		if (strcmp(b->name, system_envs[i].name) == 0)
+			type = system_envs[i].type;
+	if (type != ENV_TYPE_USER) {
+		for (i = 0; i < NENV; i++)
+			if (envs[i].env_type == type
+			    && (envs[i].env_status == ENV_RUNNABLE
+				|| envs[i].env_status == ENV_RUNNING
+				|| envs[i].env_status == ENV_NOT_RUNNABLE)) {
+				*newenv_store = &envs[i];
+				return 0;
+			}
+		parent_id = 0;
+	}
+
+	if ((r = env_alloc(&e, parent_id)) < 0)
+		return r;
+	if ((r = load_icode(e, b->start, b->end - b->start)) < 0
+	    || (argv && (r = env_setup_args(e, argv)) < 0)) {
+		env_free(e);
+		return r;
+	}
+	env_set_type(e, type);
+	*newenv_store = e;
+	return 0;
 }
 
 //
@@ -423,46 +619,33 @@ env_create(uint8_t *binary, enum EnvType type)
 void
 env_free(struct Env *e)
 {
-	pte_t *pt;
-	uint32_t pdeno, pteno;
-	physaddr_t pa;
+	uint32_t pdeno;
+	pde_t *pgdir;
 
 	// If freeing the current environment, switch to kern_pgdir
 	// before freeing the page directory, just in case the page
-	// gets reused.
-	if (e == curenv)
+	// gets reused.  This also flushes the env's user mappings
+	// from the TLB, so the page tables can be torn down below
+	// without any per-page invlpg.
+	if (e == curenv) {
 		lcr3(PADDR(kern_pgdir));
+		pmu_switch(NULL);
+	}
+	fpu_env_free(e);
 
 	// Note the environment's demise.
 	cprintf("[%08x] free env %08x\n", curenv ? curenv->env_id : 0, e->env_id);
 
-	// Flush all mapped pages in the user portion of the address space
+	// Flush all mapped pages in the user portion of the address space,
+	// one whole page table at a time.
 	static_assert(UTOP % PTSIZE == 0);
-	for (pdeno = 0; pdeno < PDX(UTOP); pdeno++) {
+	for (pdeno = 0; pdeno < PDX(UTOP); pdeno++)
+		page_table_remove(e->env_pgdir, pdeno);
 
-		// only look at mapped page tables
-		if (!(e->env_pgdir[pdeno] & PTE_P))
-			continue;
-
-		// find the pa and va of the page table
-		pa = PTE_ADDR(e->env_pgdir[pdeno]);
-		pt = (pte_t*) KADDR(pa);
-
-		// unmap all PTEs in this page table
-		for (pteno = 0; pteno <= PTX(~0); pteno++) {
-			if (pt[pteno] & PTE_P)
-				page_remove(e->env_pgdir, PGADDR(pdeno, pteno, 0));
-		}
-
-		// free the page table itself
-		e->env_pgdir[pdeno] = 0;
-		page_decref(pa2page(pa));
-	}
-
-	// free the page directory
-	pa = PADDR(e->env_pgdir);
+	// free (or recycle) the page directory
+	pgdir = e->env_pgdir;
 	e->env_pgdir = 0;
-	page_decref(pa2page(pa));
+	env_release_vm(pgdir);
 
 	// return the environment to the free list
 	e->env_status = ENV_FREE;
@@ -472,15 +655,18 @@ env_free(struct Env *e)
 
 //
 // Frees environment e.
+// If e was the current env, then runs a new environment (and does not
+// return to the caller).
 //
 void
 env_destroy(struct Env *e)
 {
 	env_free(e);
 
-	cprintf("Destroyed the only environment - nothing more to do!\n");
-	while (1)
-		monitor(NULL);
+	if (curenv == e) {
+		curenv = NULL;
+		sched_yield();
+	}
 }
 
 
@@ -544,6 +730,8 @@ env_run(struct Env *e)
         curenv->env_runs++;
         //panic("paddr: %p, curenv->env_pgdir: %p\nkern_pgdir paddr: %p, kern_pgdir: %p\n", PADDR(curenv->env_pgdir), curenv->env_pgdir, PADDR(kern_pgdir), kern_pgdir);
         lcr3(PADDR(curenv->env_pgdir)); //jumpback
+        pmu_switch(curenv);
+        fpu_switch(curenv);
 
         env_pop_tf(&(curenv->env_tf));
         panic("WHY DOES IT NEVER GET HERE & JUMP INTO MONITOR ABOVE");
@@ -9,11 +9,25 @@ extern struct Env *envs;		// All environments
 extern struct Env *curenv;		// Current environment
 extern struct Segdesc gdt[];
 
+// Number of freed page directories env_free keeps around for reuse
+#define ENV_PGDIR_CACHE_SIZE	16
+
+struct PgdirCacheStats {
+	uint32_t size;			// Capacity of the cache
+	uint32_t len;			// Page directories currently cached
+	uint32_t hits;			// env_setup_vm calls served from the cache
+	uint32_t misses;		// env_setup_vm calls that had to allocate
+};
+
+extern struct PgdirCacheStats pgdir_cache_stats;
+
 void	env_init(void);
 void	env_init_percpu(void);
 int	env_alloc(struct Env **e, envid_t parent_id);
 void	env_free(struct Env *e);
-void	env_create(uint8_t *binary, enum EnvType type);
+void	env_create(uint8_t *binary, size_t size, enum EnvType type);
+int	env_spawn(const char *name, const char **argv, envid_t parent_id,
+		  struct Env **newenv_store);
 void	env_destroy(struct Env *e);	// Does not return if e == curenv
 
 int	envid2env(envid_t envid, struct Env **env_store, bool checkperm);
@@ -27,9 +41,30 @@ void	env_pop_tf(struct Trapframe *tf) __attribute__((noreturn));
 
 #define ENV_CREATE(x, type)						\
 	do {								\
-		extern uint8_t ENV_PASTE3(_binary_obj_, x, _start)[];	\
+		extern uint8_t ENV_PASTE3(_binary_obj_, x, _start)[],	\
+			ENV_PASTE3(_binary_obj_, x, _end)[];		\
 		env_create(ENV_PASTE3(_binary_obj_, x, _start),		\
+			   ENV_PASTE3(_binary_obj_, x, _end) -		\
+			   ENV_PASTE3(_binary_obj_, x, _start),		\
 			   type);					\
 	} while (0)
 
+// Longest program name env_spawn accepts, including the terminator
+#define ENV_NAME_MAX	64
+// Most arguments sys_spawn passes to a new environment
+#define ENV_MAXARGS	32
+
+// A user program image linked into the kernel (KERN_BINFILES in
+// kern/Makefrag).  The table itself is generated at build time.
+struct EmbeddedBinary {
+	const char *name;		// Path under obj/, e.g. "user/hello"
+	uint8_t *start;			// First byte of the ELF image
+	uint8_t *end;			// One past its last byte
+};
+
+extern const struct EmbeddedBinary embedded_binaries[];
+extern const int nembedded_binaries;
+
+const struct EmbeddedBinary *embedded_binary_lookup(const char *name);
+
 #endif // !JOS_KERN_ENV_H
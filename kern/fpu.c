@@ -0,0 +1,104 @@
+// Lazy FPU/SSE context switching.
+//
+// The FPU registers belong to at most one environment at a time, the
+// owner.  env_run sets CR0_TS whenever it runs any other environment,
+// so that environment's first FPU or SSE instruction raises T_DEVICE.
+// The handler then saves the owner's state into its env_fpu area,
+// loads the new environment's state (or a clean FPU on first use) and
+// makes it the owner.  Environments that never touch the FPU never pay
+// for saving or restoring it.
+//
+// The kernel itself never uses the FPU.
+
+#include <inc/assert.h>
+#include <inc/mmu.h>
+#include <inc/x86.h>
+
+#include <kern/env.h>
+#include <kern/fpu.h>
+
+#define CPUID_EDX_FXSR	(1 << 24)
+#define CPUID_EDX_SSE	(1 << 25)
+#define MXCSR_DEFAULT	0x1f80		// All SIMD exceptions masked
+
+static struct Env *fpu_owner;
+static bool has_fxsr, has_sse;
+
+static inline void
+clts(void)
+{
+	asm volatile("clts");
+}
+
+void
+fpu_init(void)
+{
+	uint32_t edx;
+
+	cpuid(1, NULL, NULL, NULL, &edx);
+	has_fxsr = (edx & CPUID_EDX_FXSR) != 0;
+	has_sse = has_fxsr && (edx & CPUID_EDX_SSE);
+	if (has_fxsr)
+		lcr4(rcr4() | CR4_OSFXSR | (has_sse ? CR4_OSXMMEXCPT : 0));
+}
+
+// Called by env_run: trap the FPU unless 'e' already owns it.
+void
+fpu_switch(struct Env *e)
+{
+	uint32_t old = rcr0(), cr0;
+
+	if (e == fpu_owner)
+		cr0 = old & ~CR0_TS;
+	else
+		cr0 = old | CR0_TS;
+	if (cr0 != old)
+		lcr0(cr0);
+}
+
+static void
+fpu_save(struct Env *e)
+{
+	if (has_fxsr)
+		asm volatile("fxsave %0" : "=m" (e->env_fpu));
+	else
+		asm volatile("fnsave %0; fwait" : "=m" (e->env_fpu));
+}
+
+static void
+fpu_restore(struct Env *e)
+{
+	if (has_fxsr)
+		asm volatile("fxrstor %0" : : "m" (e->env_fpu));
+	else
+		asm volatile("frstor %0" : : "m" (e->env_fpu));
+}
+
+// Handle T_DEVICE from curenv: hand the FPU over to it.
+void
+fpu_trap(void)
+{
+	uint32_t mxcsr = MXCSR_DEFAULT;
+
+	assert(curenv && curenv != fpu_owner);
+	clts();
+	if (fpu_owner)
+		fpu_save(fpu_owner);
+	if (curenv->env_fpu_used)
+		fpu_restore(curenv);
+	else {
+		asm volatile("fninit");
+		if (has_sse)
+			asm volatile("ldmxcsr %0" : : "m" (mxcsr));
+		curenv->env_fpu_used = 1;
+	}
+	fpu_owner = curenv;
+}
+
+// The FPU state of an environment that is being freed is garbage.
+void
+fpu_env_free(struct Env *e)
+{
+	if (fpu_owner == e)
+		fpu_owner = NULL;
+}
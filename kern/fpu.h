@@ -0,0 +1,16 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_FPU_H
+#define JOS_KERN_FPU_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/env.h>
+
+void	fpu_init(void);
+void	fpu_switch(struct Env *e);
+void	fpu_trap(void);
+void	fpu_env_free(struct Env *e);
+
+#endif	// !JOS_KERN_FPU_H
@@ -6,10 +6,15 @@
 
 #include <kern/monitor.h>
 #include <kern/console.h>
+#include <kern/klog.h>
 #include <kern/pmap.h>
 #include <kern/kclock.h>
 #include <kern/env.h>
 #include <kern/trap.h>
+#include <kern/picirq.h>
+#include <kern/pmu.h>
+#include <kern/fpu.h>
+#include <kern/sched.h>
 
 
 void
@@ -26,6 +31,12 @@ i386_init(void)
 	// Can't call cprintf until after we do this!
 	cons_init();
 
+	// Checksum the kernel text before anything can scribble on it
+	monitor_init();
+
+	// Kernel log levels and sink controls
+	check_klog();
+
 	cprintf("444544 decimal is %o octal!\n", 444544);
 
 	// Lab 2 memory management initialization functions
@@ -35,6 +46,15 @@ i386_init(void)
 	env_init();
 	trap_init();
 
+	// Interrupt controller; all IRQs stay masked until needed
+	pic_init();
+
+	// Performance counters, if the CPU exposes any
+	pmu_init();
+
+	// FXSAVE support for lazy FPU switching
+	fpu_init();
+
 #if defined(TEST)
 	// Don't touch -- used by grading script!
 	ENV_CREATE(TEST, ENV_TYPE_USER);
@@ -43,8 +63,8 @@ i386_init(void)
 	ENV_CREATE(user_hello, ENV_TYPE_USER);
 #endif // TEST*
 
-	// We only have one user environment for now, so just run it.
-	env_run(&envs[0]);
+	// Schedule and run the first user environment!
+	sched_yield();
 }
 
 
@@ -71,10 +91,11 @@ _panic(const char *file, int line, const char *fmt,...)
 	asm volatile("cli; cld");
 
 	va_start(ap, fmt);
-	cprintf("kernel panic at %s:%d: ", file, line);
-	vcprintf(fmt, ap);
-	cprintf("\n");
+	klogf(KLOG_ERR, "kernel panic at %s:%d: ", file, line);
+	vklogf(KLOG_ERR, fmt, ap);
+	klogf(KLOG_ERR, "\n");
 	va_end(ap);
+	klog_sync();
 
 dead:
 	/* break into the kernel monitor */
@@ -89,8 +110,8 @@ _warn(const char *file, int line, const char *fmt,...)
 	va_list ap;
 
 	va_start(ap, fmt);
-	cprintf("kernel warning at %s:%d: ", file, line);
-	vcprintf(fmt, ap);
-	cprintf("\n");
+	klogf(KLOG_WARN, "kernel warning at %s:%d: ", file, line);
+	vklogf(KLOG_WARN, fmt, ap);
+	klogf(KLOG_WARN, "\n");
 	va_end(ap);
 }
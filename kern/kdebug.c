@@ -103,6 +103,141 @@ stab_binsearch(const struct Stab *stabs, int *region_left, int *region_right,
 }
 
 
+// The kernel's stabs never change, so the first kernel lookup builds an
+// index of its functions sorted by start address, with the name, file
+// and argument count already resolved.  Later lookups binary-search the
+// index for the function, then search only that function's N_SLINE
+// stabs for the line, instead of searching every stab three times.
+// Addresses outside any indexed function (assembly files) fall back to
+// the full search below.
+
+#define KDEBUG_MAXFUNCS	1024
+
+struct KFunc {
+	uintptr_t addr;		// Start address of the function
+	uintptr_t file_end;	// Address where its source file's code ends
+	const char *name;	// Name, not null terminated
+	int namelen;		// Length of name
+	const char *file;	// Source file name
+	int narg;		// Number of arguments
+	int lstab, rstab;	// The function's stabs, for line lookups
+};
+
+static struct KFunc kfuncs[KDEBUG_MAXFUNCS];
+static int nkfuncs;
+static enum { KINDEX_NONE, KINDEX_OK, KINDEX_FAILED } kindex_state;
+
+static int
+kindex_build(void)
+{
+	const struct Stab *stabs = __STAB_BEGIN__;
+	int nstabs = __STAB_END__ - __STAB_BEGIN__;
+	int strsize = __STABSTR_END__ - __STABSTR_BEGIN__;
+	const char *file = "<unknown>";
+	int i, j, file_first = 0;
+	struct KFunc *f = NULL, tmp;
+
+	for (i = 0; i < nstabs; i++) {
+		const struct Stab *st = &stabs[i];
+		const char *str = "";
+
+		if (st->n_strx < strsize)
+			str = __STABSTR_BEGIN__ + st->n_strx;
+		switch (st->n_type) {
+		case N_SO:
+			if (!st->n_value)
+				break;
+			// A new source file (or the end of one) ends the
+			// functions of the previous file.
+			for (j = file_first; j < nkfuncs; j++)
+				kfuncs[j].file_end = st->n_value;
+			file_first = nkfuncs;
+			if (f)
+				f->rstab = i - 1;
+			f = NULL;
+			file = str;
+			break;
+		case N_SOL:
+			file = str;
+			break;
+		case N_FUN:
+			if (f)
+				f->rstab = i - 1;
+			f = NULL;
+			if (!*str)
+				break;
+			if (nkfuncs == KDEBUG_MAXFUNCS)
+				return -1;
+			f = &kfuncs[nkfuncs++];
+			f->addr = st->n_value;
+			f->file_end = ~(uintptr_t) 0;
+			f->name = str;
+			f->namelen = strfind(str, ':') - str;
+			f->file = file;
+			f->narg = 0;
+			f->lstab = f->rstab = i;
+			break;
+		case N_PSYM:
+			if (f && i == f->lstab + 1 + f->narg)
+				f->narg++;
+			break;
+		}
+	}
+	if (f)
+		f->rstab = nstabs - 1;
+
+	// The linker lays files out in order, so this is nearly sorted
+	// already and insertion sort is quick.
+	for (i = 1; i < nkfuncs; i++) {
+		tmp = kfuncs[i];
+		for (j = i; j > 0 && kfuncs[j - 1].addr > tmp.addr; j--)
+			kfuncs[j] = kfuncs[j - 1];
+		kfuncs[j] = tmp;
+	}
+	return 0;
+}
+
+// Fill in 'info' for kernel address 'addr' from the function index.
+// Returns 0 on success, -1 if the caller must search the stabs.
+static int
+kindex_lookup(uintptr_t addr, struct Eipdebuginfo *info)
+{
+	const struct KFunc *f;
+	int l, r, m, lline, rline;
+
+	if (kindex_state == KINDEX_NONE)
+		kindex_state = kindex_build() < 0 ? KINDEX_FAILED : KINDEX_OK;
+	if (kindex_state != KINDEX_OK)
+		return -1;
+
+	// Find the last function starting at or before addr.
+	l = 0;
+	r = nkfuncs - 1;
+	while (l <= r) {
+		m = (l + r) / 2;
+		if (kfuncs[m].addr <= addr)
+			l = m + 1;
+		else
+			r = m - 1;
+	}
+	if (r < 0 || addr >= kfuncs[r].file_end)
+		return -1;
+	f = &kfuncs[r];
+
+	info->eip_file = f->file;
+	info->eip_fn_name = f->name;
+	info->eip_fn_namelen = f->namelen;
+	info->eip_fn_addr = f->addr;
+	info->eip_fn_narg = f->narg;
+
+	lline = f->lstab;
+	rline = f->rstab;
+	stab_binsearch(__STAB_BEGIN__, &lline, &rline, N_SLINE, addr - f->addr);
+	info->eip_line = lline <= rline ? __STAB_BEGIN__[lline].n_desc : -1;
+	return 0;
+}
+
+
 // debuginfo_eip(addr, info)
 //
 //	Fill in the 'info' structure with information about the specified
@@ -126,6 +261,8 @@ debuginfo_eip(uintptr_t addr, struct Eipdebuginfo *info)
 	info->eip_fn_narg = 0;
 
 	// Find the relevant set of stabs
+	if (addr >= ULIM && kindex_lookup(addr, info) == 0)
+		return 0;
 	if (addr >= ULIM) {
 		stabs = __STAB_BEGIN__;
 		stab_end = __STAB_END__;
@@ -140,8 +277,9 @@ debuginfo_eip(uintptr_t addr, struct Eipdebuginfo *info)
 		const struct UserStabData *usd = (const struct UserStabData *) USTABDATA;
 
 		// Make sure this memory is valid.
-		// Return -1 if it is not.  Hint: Call user_mem_check.
-		// LAB 3: Your code here.
+		// Return -1 if it is not.
+		if (!curenv || user_mem_check(curenv, usd, sizeof(*usd), PTE_U) < 0)
+			return -1;
 
 		stabs = usd->stabs;
 		stab_end = usd->stab_end;
@@ -149,7 +287,10 @@ debuginfo_eip(uintptr_t addr, struct Eipdebuginfo *info)
 		stabstr_end = usd->stabstr_end;
 
 		// Make sure the STABS and string table memory is valid.
-		// LAB 3: Your code here.
+		if (stab_end < stabs || stabstr_end < stabstr
+		    || user_mem_check(curenv, stabs, (uintptr_t) stab_end - (uintptr_t) stabs, PTE_U) < 0
+		    || user_mem_check(curenv, stabstr, stabstr_end - stabstr, PTE_U) < 0)
+			return -1;
 	}
 
 	// String table validity checks
@@ -216,7 +357,7 @@ debuginfo_eip(uintptr_t addr, struct Eipdebuginfo *info)
         int lline2 = lline, rline2 = rline;
         stab_binsearch(stabs, &lline2, &rline2, N_SLINE, addr);
         if (lline2 <= rline2) {
-            info->eip_line = stabs[lline2].n_value;
+            info->eip_line = stabs[lline2].n_desc;
         } else {
             info->eip_line = -1;
         }
@@ -0,0 +1,239 @@
+// Kernel log.
+//
+// cprintf and friends append to a ring of recent output, tagging each
+// byte with its log level.  Each sink (serial port, printer, display,
+// and an in-memory history) keeps its own position in the ring and
+// writes as much as its device will take without waiting, so a slow or
+// missing device costs nothing but the output it misses.  A sink that
+// falls more than KLOG_SIZE bytes behind loses the oldest output.
+//
+// The serial port is the console that matters, and with its FIFO off
+// it takes one byte at a time, so by default its sink waits for it as
+// cprintf always used to (a bounded spin per byte, serial_putc).
+// The 'wait' flag of any sink can be changed from the monitor.
+//
+// Sinks are drained after each cprintf.  klog_sync instead waits for
+// each device, for when the kernel is about to stop (panic) or sleep.
+
+#include <inc/assert.h>
+#include <inc/error.h>
+#include <inc/stdio.h>
+#include <inc/string.h>
+
+#include <kern/console.h>
+#include <kern/klog.h>
+#include <kern/monitor.h>
+
+static char klog_buf[KLOG_SIZE];
+static uint8_t klog_lvl[KLOG_SIZE];
+static uint32_t klog_wpos;		// Bytes ever logged
+
+static char klog_mem[KLOG_MEMSIZE];
+static uint32_t klog_mem_wpos;
+
+static int
+mem_putc(int c, bool wait)
+{
+	klog_mem[klog_mem_wpos++ % KLOG_MEMSIZE] = c;
+	return 0;
+}
+
+struct KlogSink klog_sinks[] = {
+	{ "serial", serial_putc, NULL, true, true, KLOG_DEBUG },
+	{ "lpt", lpt_putc, NULL, true, false, KLOG_INFO },
+	{ "cga", cga_putc, cga_sync, true, false, KLOG_INFO },
+	{ "memory", mem_putc, NULL, true, false, KLOG_DEBUG },
+};
+const int klog_nsinks = ARRAY_SIZE(klog_sinks);
+
+const char *const klog_level_names[KLOG_NLEVELS] = {
+	[KLOG_ERR] = "err",
+	[KLOG_WARN] = "warn",
+	[KLOG_INFO] = "info",
+	[KLOG_DEBUG] = "debug",
+};
+
+// Append a character to the log.  Sinks do not see it until the next
+// klog_drain, except that a long message drains as it goes so it does
+// not overrun the ring on its own.
+void
+klog_putc(int level, int c)
+{
+	uint32_t i = klog_wpos++ & (KLOG_SIZE - 1);
+
+	klog_buf[i] = c;
+	klog_lvl[i] = level;
+	if ((klog_wpos & (KLOG_SIZE / 2 - 1)) == 0)
+		klog_drain();
+}
+
+static void
+klog_drain_sink(struct KlogSink *s, bool wait)
+{
+	uint32_t i;
+
+	// A disabled sink skips whatever is logged meanwhile.
+	if (!s->enabled) {
+		s->rpos = klog_wpos;
+		return;
+	}
+	if (klog_wpos - s->rpos > KLOG_SIZE) {
+		s->dropped += klog_wpos - s->rpos - KLOG_SIZE;
+		s->rpos = klog_wpos - KLOG_SIZE;
+	}
+	while (s->rpos != klog_wpos) {
+		i = s->rpos & (KLOG_SIZE - 1);
+		if (klog_lvl[i] <= s->level && s->putc(klog_buf[i], wait) < 0) {
+			// A device that never comes ready is not there;
+			// don't wait for it once per byte.
+			if (wait) {
+				s->dropped += klog_wpos - s->rpos;
+				s->rpos = klog_wpos;
+			}
+			break;
+		}
+		s->rpos++;
+	}
+	if (s->flush)
+		s->flush();
+}
+
+// Write pending output to each sink, as far as it will go without
+// waiting, except for sinks set to always wait.
+void
+klog_drain(void)
+{
+	int i;
+
+	for (i = 0; i < klog_nsinks; i++)
+		klog_drain_sink(&klog_sinks[i], klog_sinks[i].wait);
+}
+
+// Write all pending output, waiting for each device.
+void
+klog_sync(void)
+{
+	int i;
+
+	for (i = 0; i < klog_nsinks; i++)
+		klog_drain_sink(&klog_sinks[i], true);
+}
+
+// Returns the sink called 'name', or NULL if there is none.
+struct KlogSink *
+klog_sink(const char *name)
+{
+	int i;
+
+	for (i = 0; i < klog_nsinks; i++)
+		if (strcmp(klog_sinks[i].name, name) == 0)
+			return &klog_sinks[i];
+	return NULL;
+}
+
+// Parses a log level given by name or number.
+// Returns the level, or -E_INVAL if 'name' is neither.
+int
+klog_level(const char *name)
+{
+	int i;
+
+	for (i = 0; i < KLOG_NLEVELS; i++)
+		if (strcmp(klog_level_names[i], name) == 0)
+			return i;
+	if (name[0] >= '0' && name[0] < '0' + KLOG_NLEVELS && name[1] == '\0')
+		return name[0] - '0';
+	return -E_INVAL;
+}
+
+// Print the history kept by the memory sink.
+void
+klog_dmesg(void)
+{
+	struct KlogSink *s = klog_sink("memory");
+	uint32_t start, n;
+	bool enabled;
+
+	// Bring the history up to date, then keep the dump out of it.
+	klog_drain();
+	enabled = s->enabled;
+	s->enabled = false;
+
+	n = MIN(klog_mem_wpos, KLOG_MEMSIZE);
+	start = (klog_mem_wpos - n) % KLOG_MEMSIZE;
+	if (start + n > KLOG_MEMSIZE) {
+		cprintf("%.*s", KLOG_MEMSIZE - start, klog_mem + start);
+		n -= KLOG_MEMSIZE - start;
+		start = 0;
+	}
+	cprintf("%.*s", n, klog_mem + start);
+
+	s->enabled = enabled;
+}
+
+// Does the memory sink's history end with 'str'?
+static bool
+klog_mem_endswith(const char *str)
+{
+	uint32_t n = strlen(str), i;
+
+	if (n > MIN(klog_mem_wpos, KLOG_MEMSIZE))
+		return 0;
+	for (i = 0; i < n; i++)
+		if (klog_mem[(klog_mem_wpos - n + i) % KLOG_MEMSIZE] != str[i])
+			return 0;
+	return 1;
+}
+
+// Check levels, enabling and disabling, and the klog monitor command,
+// using the memory sink.  The other sinks are turned off meanwhile so
+// the test messages stay off the console.
+void
+check_klog(void)
+{
+	struct KlogSink *mem = klog_sink("memory");
+	struct KlogSink saved[ARRAY_SIZE(klog_sinks)];
+	char *level_warn[] = { "klog", "memory", "level", "warn" };
+	char *level_bad[] = { "klog", "memory", "level", "loud" };
+	char *off[] = { "klog", "memory", "off" };
+	char *on[] = { "klog", "memory", "on" };
+	uint32_t wpos;
+	int i;
+
+	klog_drain();
+	memmove(saved, klog_sinks, sizeof(saved));
+	for (i = 0; i < klog_nsinks; i++)
+		klog_sinks[i].enabled = (&klog_sinks[i] == mem);
+
+	assert(klog_level("debug") == KLOG_DEBUG);
+	assert(klog_level("0") == KLOG_ERR);
+	assert(klog_level("4") < 0 && klog_level("loud") < 0);
+
+	// Messages above the sink's level are filtered out.
+	mon_klog(4, level_warn, NULL);
+	assert(mem->level == KLOG_WARN);
+	klogf(KLOG_WARN, "klog warn\n");
+	assert(klog_mem_endswith("klog warn\n"));
+	klogf(KLOG_INFO, "klog info\n");
+	assert(klog_mem_endswith("klog warn\n"));
+	mon_klog(4, level_bad, NULL);
+	assert(mem->level == KLOG_WARN);
+
+	// A disabled sink skips output, and does not see it once enabled.
+	mon_klog(3, off, NULL);
+	assert(!mem->enabled);
+	wpos = klog_mem_wpos;
+	klogf(KLOG_ERR, "klog off\n");
+	mon_klog(3, on, NULL);
+	klog_drain();
+	assert(mem->enabled && klog_mem_wpos == wpos);
+
+	// dmesg prints the history without adding to it.
+	klog_dmesg();
+	assert(klog_mem_wpos == wpos);
+
+	memmove(klog_sinks, saved, sizeof(saved));
+	for (i = 0; i < klog_nsinks; i++)
+		klog_sinks[i].rpos = klog_wpos;
+	cprintf("check_klog() succeeded!\n");
+}
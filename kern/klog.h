@@ -0,0 +1,51 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_KLOG_H
+#define JOS_KERN_KLOG_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/stdarg.h>
+
+// Log levels, most severe first.  A sink prints a message if the
+// message's level is at most the sink's level.
+#define KLOG_ERR	0
+#define KLOG_WARN	1
+#define KLOG_INFO	2	// cprintf
+#define KLOG_DEBUG	3
+#define KLOG_NLEVELS	4
+
+#define KLOG_SIZE	16384	// Bytes in the log ring; a power of 2
+#define KLOG_MEMSIZE	4096	// Bytes kept by the in-memory sink
+
+struct KlogSink {
+	const char *name;
+	// Write one character.  Returns < 0 if the device is busy; with
+	// 'wait' set it is only busy if it does not come ready at all.
+	int (*putc)(int c, bool wait);
+	void (*flush)(void);		// Finish a batch, or NULL
+	bool enabled;
+	bool wait;			// Always wait for the device?
+	int level;
+	uint32_t rpos;			// Next ring byte to write
+	uint32_t dropped;		// Bytes overwritten before written
+};
+
+extern struct KlogSink klog_sinks[];
+extern const int klog_nsinks;
+extern const char *const klog_level_names[KLOG_NLEVELS];
+
+void	klog_putc(int level, int c);
+void	klog_drain(void);
+void	klog_sync(void);
+struct KlogSink *klog_sink(const char *name);
+int	klog_level(const char *name);
+void	klog_dmesg(void);
+void	check_klog(void);
+
+int	vklogf(int level, const char *fmt, va_list ap);
+int	klogf(int level, const char *fmt, ...);
+
+#endif	// !JOS_KERN_KLOG_H
@@ -6,11 +6,17 @@
 #include <inc/memlayout.h>
 #include <inc/assert.h>
 #include <inc/x86.h>
+#include <inc/crc.h>
 
 #include <kern/console.h>
 #include <kern/monitor.h>
 #include <kern/kdebug.h>
 #include <kern/trap.h>
+#include <kern/env.h>
+#include <kern/prof.h>
+#include <kern/klog.h>
+#include <kern/pmu.h>
+#include <kern/sched.h>
 #include <inc/types.h>
 
 #include <kern/pmap.h>
@@ -20,6 +26,12 @@
 
 extern pde_t *kern_pgdir;
 
+// crc32c of [entry, etext) taken at boot; see monitor_init.  kerninfo
+// compares against it as a runtime self-check: it catches the kernel
+// text being overwritten after boot, but says nothing about whether
+// the image that was booted is the one that was built.
+static uint32_t kern_text_crc;
+
 struct Command {
 	const char *name;
 	const char *desc;
@@ -32,7 +44,11 @@ static struct Command commands[] = {
 	{ "help", "Display this list of commands", mon_help },
 	{ "kerninfo", "Display information about the kernel", mon_kerninfo },
         { "show", "Show a dope neofetch pretty-print", mon_show },
-        { "dbg", "Debug memory", mon_dbg }
+        { "dbg", "Debug memory", mon_dbg },
+        { "envcache", "Show the env page directory cache size and hit rate", mon_envcache },
+        { "pmu", "Show performance counter totals for each environment", mon_pmu },
+        { "prof", "Sampling profiler: prof start|stop|report [graph]|run <prog> [args]", mon_prof },
+        { "klog", "Kernel log sinks: klog [<sink> on|off|wait on|off|level <level>] | klog dmesg", mon_klog }
 };
 
 struct Flag {
@@ -235,6 +251,7 @@ int
 mon_kerninfo(int argc, char **argv, struct Trapframe *tf)
 {
 	extern char _start[], entry[], etext[], edata[], end[];
+	uint32_t crc;
 
 	cprintf("Special kernel symbols:\n");
 	cprintf("  _start                  %08x (phys)\n", _start);
@@ -244,6 +261,121 @@ mon_kerninfo(int argc, char **argv, struct Trapframe *tf)
 	cprintf("  end    %08x (virt)  %08x (phys)\n", end, end - KERNBASE);
 	cprintf("Kernel executable memory footprint: %dKB\n",
 		ROUNDUP(end - entry, 1024) / 1024);
+	crc = crc32c(0, entry, etext - entry);
+	cprintf("Kernel text crc32c: %08x (%s)\n", crc,
+		crc == kern_text_crc ? "unchanged since boot" : "CHANGED SINCE BOOT");
+	return 0;
+}
+
+int
+mon_envcache(int argc, char **argv, struct Trapframe *tf)
+{
+	struct PgdirCacheStats *st = &pgdir_cache_stats;
+	uint32_t lookups = st->hits + st->misses;
+
+	cprintf("page directory cache: %u/%u cached\n", st->len, st->size);
+	cprintf("  hits %u  misses %u  hit rate %u%%\n", st->hits, st->misses,
+		lookups ? (st->hits * 100) / lookups : 0);
+	return 0;
+}
+
+int
+mon_pmu(int argc, char **argv, struct Trapframe *tf)
+{
+	const struct Env *e;
+	int i;
+
+	if (pmu_ncounters == 0) {
+		cprintf("no performance counters (QEMU needs KVM and -cpu host)\n");
+		return 0;
+	}
+
+	// Bring the running env's totals up to date.
+	if (curenv)
+		pmu_switch(curenv);
+
+	cprintf("env     ");
+	for (i = 0; i < pmu_ncounters; i++)
+		cprintf(" %16s", pmu_events[i].name);
+	cprintf("\n");
+	for (e = envs; e < envs + NENV; e++) {
+		if (e->env_status == ENV_FREE)
+			continue;
+		cprintf("%08x", e->env_id);
+		for (i = 0; i < pmu_ncounters; i++)
+			cprintf(" %16llu", e->env_pmc[i]);
+		cprintf("\n");
+	}
+	return 0;
+}
+
+// prof start		clear the profile and start sampling
+// prof stop		stop sampling
+// prof report [graph]	print the flat profile, and the call graph
+// prof run <prog> ...	start sampling and run an embedded program;
+//			'prof report' once the monitor comes back
+int
+mon_prof(int argc, char **argv, struct Trapframe *tf)
+{
+	struct Env *e;
+	int r;
+
+	if (argc == 2 && strcmp(argv[1], "start") == 0)
+		prof_start();
+	else if (argc == 2 && strcmp(argv[1], "stop") == 0)
+		prof_stop();
+	else if (argc >= 2 && strcmp(argv[1], "report") == 0)
+		prof_report(argc >= 3 && strcmp(argv[2], "graph") == 0);
+	else if (argc >= 3 && strcmp(argv[1], "run") == 0) {
+		if ((r = env_spawn(argv[2], (const char **) argv + 2, 0, &e)) < 0) {
+			cprintf("prof: cannot run %s: %e\n", argv[2], r);
+			return 0;
+		}
+		prof_start();
+		sched_yield();
+	} else
+		cprintf("usage: prof start|stop|report [graph]|run <prog> [args]\n");
+	return 0;
+}
+
+int
+mon_klog(int argc, char **argv, struct Trapframe *tf)
+{
+	struct KlogSink *s;
+	int i, level;
+
+	if (argc == 1) {
+		for (i = 0; i < klog_nsinks; i++) {
+			s = &klog_sinks[i];
+			cprintf("%-8s %-3s  %-6s  level %-5s  dropped %u\n", s->name,
+				s->enabled ? "on" : "off", s->wait ? "wait" : "nowait",
+				klog_level_names[s->level], s->dropped);
+		}
+		return 0;
+	}
+	if (argc == 2 && strcmp(argv[1], "dmesg") == 0) {
+		klog_dmesg();
+		return 0;
+	}
+	if (!(s = klog_sink(argv[1]))) {
+		cprintf("klog: no sink %s\n", argv[1]);
+		return 0;
+	}
+	if (argc == 3 && strcmp(argv[2], "on") == 0)
+		s->enabled = true;
+	else if (argc == 3 && strcmp(argv[2], "off") == 0)
+		s->enabled = false;
+	else if (argc == 4 && strcmp(argv[2], "wait") == 0
+		 && (strcmp(argv[3], "on") == 0 || strcmp(argv[3], "off") == 0))
+		s->wait = strcmp(argv[3], "on") == 0;
+	else if (argc == 4 && strcmp(argv[2], "level") == 0) {
+		if ((level = klog_level(argv[3])) < 0) {
+			cprintf("klog: bad level %s (err, warn, info or debug)\n", argv[3]);
+			return 0;
+		}
+		s->level = level;
+	} else
+		cprintf("usage: klog [<sink> on|off|wait on|off|level <level>] | klog dmesg\n");
 	return 0;
 }
 
@@ -338,6 +470,14 @@ runcmd(char *buf, struct Trapframe *tf)
 	return 0;
 }
 
+void
+monitor_init(void)
+{
+	extern char entry[], etext[];
+
+	kern_text_crc = crc32c(0, entry, etext - entry);
+}
+
 void
 monitor(struct Trapframe *tf)
 {
@@ -11,11 +11,19 @@ struct Trapframe;
 // (NULL if none).
 void monitor(struct Trapframe *tf);
 
+// Record a checksum of the kernel text so kerninfo can tell whether it
+// has changed since boot.
+void monitor_init(void);
+
 // Functions implementing monitor commands.
 int mon_dbg(int argc, char **argv, struct Trapframe *tf);
 int mon_help(int argc, char **argv, struct Trapframe *tf);
 int mon_kerninfo(int argc, char **argv, struct Trapframe *tf);
 int mon_show(int argc, char **argv, struct Trapframe *tf);
+int mon_envcache(int argc, char **argv, struct Trapframe *tf);
+int mon_pmu(int argc, char **argv, struct Trapframe *tf);
+int mon_prof(int argc, char **argv, struct Trapframe *tf);
+int mon_klog(int argc, char **argv, struct Trapframe *tf);
 int mon_backtrace(int argc, char **argv, struct Trapframe *tf);
 
 uint32_t b16to10(const char *str);
@@ -295,8 +295,6 @@ void page_init(void) {
     // NB: DO NOT actually touch the physical memory corresponding to
     // free pages!
     
-    extern char end[];
-    int reserved_page_count = (ROUNDUP(npages * sizeof(struct PageInfo), PGSIZE) / PGSIZE);
 
     size_t i;
     for (i = 0; i < npages; i++) {
@@ -318,7 +316,9 @@ void page_init(void) {
         //cprintf("- 2\n");
         if (va >= UXSTACKTOP - PGSIZE && va <= KERNBASE) continue;
         //cprintf("- 3\n");
-        if (pa >= KERNELADDR && va <= ((uint32_t) &end) + (reserved_page_count * PGSIZE)) continue;
+        // The kernel image and everything boot_alloc handed out
+        // (kern_pgdir, pages, envs) end at boot_alloc(0).
+        if (pa >= EXTPHYSMEM && va < (uint32_t) boot_alloc(0)) continue;
         //cprintf("- 4\n");
         if ((void *)va >= (void *)kern_pgdir && (void *)va <= (void *)kern_pgdir + PGSIZE) continue;
         if ((void *)va >= (void *)pages && (void *)va <= (void *)(pages + (npages * sizeof(struct PageInfo)))) continue;
@@ -585,7 +585,7 @@ page_lookup(pde_t *pgdir, void *va, pte_t **pte_store)
         *pte_store = pte;
     }
 
-    if (!pte) return NULL;
+    if (!pte || !(*pte & PTE_P)) return NULL;
 
     physaddr_t pa = (physaddr_t) *pte; // the pa also stores flags btw
     struct PageInfo *retval = pa2page(pa);
@@ -629,6 +629,45 @@ page_remove(pde_t *pgdir, void *va)
     tlb_invalidate(pgdir, va);
 }
 
+//
+// Unmaps every page in the page table at pgdir[pdeno] and frees the
+// page table page itself, leaving the PDE empty.
+//
+// This is the bulk counterpart to calling page_remove() on each PTE:
+// the page table is scanned directly instead of re-walking pgdir for
+// every entry, and the PTEs themselves are never cleared, since the
+// whole page table page is freed at the end (pgdir_walk zeroes page
+// tables when it allocates them).
+//
+// No TLB entries are invalidated.  The caller must ensure pgdir is not
+// the active page directory, or flush the TLB itself (e.g. with lcr3).
+//
+void
+page_table_remove(pde_t *pgdir, uint32_t pdeno)
+{
+	pte_t *pt, *ept;
+	struct PageInfo *pp;
+
+	if (!(pgdir[pdeno] & PTE_P))
+		return;
+
+	pt = (pte_t *) KADDR(PTE_ADDR(pgdir[pdeno]));
+	for (ept = pt + NPTENTRIES; pt < ept; pt++) {
+		if (!(*pt & PTE_P))
+			continue;
+		// Pages outside of RAM (e.g. MMIO) are not reference counted
+		if (PGNUM(*pt) >= npages)
+			continue;
+		pp = &pages[PGNUM(*pt)];
+		if (--pp->pp_ref == 0)
+			page_free(pp);
+	}
+
+	pp = pa2page(PTE_ADDR(pgdir[pdeno]));
+	pgdir[pdeno] = 0;
+	page_decref(pp);
+}
+
 //
 // Invalidate a TLB entry, but only if the page tables being
 // edited are the ones currently in use by the processor.
@@ -661,12 +700,45 @@ static uintptr_t user_mem_check_addr;
 // Returns 0 if the user program can access this range of addresses,
 // and -E_FAULT otherwise.
 //
+// This is called on every user pointer a system call touches, so rather
+// than calling pgdir_walk for each page it looks up each page directory
+// entry once and then scans that page table's PTEs linearly.  A range of
+// n pages costs about n/NPTENTRIES directory lookups.
+//
 int
 user_mem_check(struct Env *env, const void *va, size_t len, int perm)
 {
-	// LAB 3: Your code here.
-
+	uintptr_t start = (uintptr_t) va;
+	uintptr_t end = start + len;
+	uintptr_t a;
+	uint32_t pdeno = NPDENTRIES;	// no page table cached yet
+	pte_t *pt = NULL;
+
+	if (len == 0)
+		return 0;
+	if (end < start)		// wrapped around the address space
+		end = ~(uintptr_t) 0;
+
+	perm |= PTE_P;
+	for (a = ROUNDDOWN(start, PGSIZE); a < end; a += PGSIZE) {
+		if (a >= ULIM)
+			goto bad;
+		if (PDX(a) != pdeno) {
+			pde_t pde = env->env_pgdir[PDX(a)];
+
+			if ((pde & perm) != perm)
+				goto bad;
+			pdeno = PDX(a);
+			pt = (pte_t *) KADDR(PTE_ADDR(pde));
+		}
+		if ((pt[PTX(a)] & perm) != perm)
+			goto bad;
+	}
 	return 0;
+
+bad:
+	user_mem_check_addr = a < start ? start : a;
+	return -E_FAULT;
 }
 
 //
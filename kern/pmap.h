@@ -58,6 +58,7 @@ struct PageInfo *page_alloc(int alloc_flags);
 void	page_free(struct PageInfo *pp);
 int	page_insert(pde_t *pgdir, struct PageInfo *pp, void *va, int perm);
 void	page_remove(pde_t *pgdir, void *va);
+void	page_table_remove(pde_t *pgdir, uint32_t pdeno);
 struct PageInfo *page_lookup(pde_t *pgdir, void *va, pte_t **pte_store);
 void	page_decref(struct PageInfo *pp);
 int     set_page_perm(pde_t *pgdir, void *va, int perm);
@@ -0,0 +1,95 @@
+// Hardware performance counters.
+//
+// pmu_init programs the first ENV_NPMC general-purpose counters with a
+// fixed set of events and sets CR4_PCE, so environments can read them
+// with rdpmc without a system call.
+//
+// The counters are virtualized per environment: pmu_switch, called as
+// env_run switches environments, adds what the counters advanced while
+// the previous environment owned them to its env_pmc[], and loads the
+// next environment's totals.  Without full-width counter writes the
+// counters can't be reloaded.  In that case env_pmc[] is still exact,
+// but rdpmc in an env returns the global count rather than the env's own.
+//
+// Plain QEMU (TCG) has no PMU; run with KVM and '-cpu host' for counters.
+
+#include <inc/stdio.h>
+#include <inc/x86.h>
+#include <inc/mmu.h>
+
+#include <kern/pmu.h>
+
+#define CPUID_LEAF_PMU		0x0a
+#define CPUID_ECX_PDCM		(1 << 15)	// PERF_CAPABILITIES MSR
+
+// Cycles, instructions and LLC misses are architectural events.  The
+// dTLB event is DTLB_LOAD_MISSES.MISS_CAUSES_A_WALK, which is
+// model-specific but has kept its encoding on Intel cores since Nehalem.
+const struct PmuEvent pmu_events[ENV_NPMC] = {
+	{ "cycles",       0x3c, 0x00 },
+	{ "instructions", 0xc0, 0x00 },
+	{ "llc-misses",   0x2e, 0x41 },
+	{ "dtlb-misses",  0x08, 0x01 },
+};
+
+int pmu_ncounters;
+static bool full_width;			// Can counters be reloaded?
+static uint64_t counter_mask;		// Counter width
+static struct Env *owner;		// Env whose counts are in the PMCs
+static uint64_t start[ENV_NPMC];	// Counter values when owner started
+
+void
+pmu_init(void)
+{
+	uint32_t maxleaf, eax, ecx;
+	int i, version, width;
+
+	cpuid(0, &maxleaf, NULL, NULL, NULL);
+	if (maxleaf < CPUID_LEAF_PMU)
+		return;
+	cpuid(CPUID_LEAF_PMU, &eax, NULL, NULL, NULL);
+	version = eax & 0xff;
+	width = (eax >> 16) & 0xff;
+	if (version == 0 || width == 0)
+		return;
+
+	pmu_ncounters = MIN((eax >> 8) & 0xff, ENV_NPMC);
+	counter_mask = width >= 64 ? ~0ULL : (1ULL << width) - 1;
+	cpuid(1, NULL, NULL, &ecx, NULL);
+	if (ecx & CPUID_ECX_PDCM)
+		full_width = (rdmsr(MSR_PERF_CAPABILITIES) & PERF_CAP_FW_WRITE) != 0;
+
+	for (i = 0; i < pmu_ncounters; i++) {
+		wrmsr(MSR_PERFEVTSEL0 + i, 0);
+		wrmsr(MSR_PMC0 + i, 0);
+		wrmsr(MSR_PERFEVTSEL0 + i,
+		      pmu_events[i].event | (pmu_events[i].umask << 8)
+		      | PERFEVTSEL_USR | PERFEVTSEL_OS | PERFEVTSEL_EN);
+	}
+	lcr4(rcr4() | CR4_PCE);
+	cprintf("pmu: version %d, %d counters of %d bits%s\n", version,
+		pmu_ncounters, width, full_width ? ", reloadable" : "");
+}
+
+// Make 'e' (or nobody, if NULL) the owner of the counters, after
+// bringing the current owner's totals up to date.
+void
+pmu_switch(struct Env *e)
+{
+	uint64_t now;
+	int i;
+
+	if (pmu_ncounters == 0)
+		return;
+	for (i = 0; i < pmu_ncounters; i++) {
+		now = rdpmc(i);
+		if (owner)
+			owner->env_pmc[i] += (now - start[i]) & counter_mask;
+		if (e && e != owner && full_width) {
+			wrmsr(MSR_A_PMC0 + i, e->env_pmc[i] & counter_mask);
+			start[i] = e->env_pmc[i] & counter_mask;
+		} else
+			start[i] = now;
+	}
+	owner = e;
+}
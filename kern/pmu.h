@@ -0,0 +1,35 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_PMU_H
+#define JOS_KERN_PMU_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/env.h>
+
+// Architectural performance monitoring MSRs
+#define MSR_PERFEVTSEL0		0x186	// IA32_PERFEVTSELx = 0x186 + x
+#define MSR_PMC0		0x0c1	// IA32_PMCx = 0xc1 + x
+#define MSR_A_PMC0		0x4c1	// Full-width writable alias of PMCx
+#define MSR_PERF_CAPABILITIES	0x345
+
+#define PERFEVTSEL_USR		0x00010000	// Count in ring 3
+#define PERFEVTSEL_OS		0x00020000	// Count in ring 0
+#define PERFEVTSEL_EN		0x00400000	// Enable counter
+#define PERF_CAP_FW_WRITE	0x00002000	// MSR_A_PMCx supported
+
+struct PmuEvent {
+	const char *name;
+	uint8_t event;			// Event select
+	uint8_t umask;			// Unit mask
+};
+
+// The events counted on counters 0..ENV_NPMC-1; rdpmc(i) reads event i.
+extern const struct PmuEvent pmu_events[ENV_NPMC];
+extern int pmu_ncounters;		// Counters in use, 0 if no PMU
+
+void	pmu_init(void);
+void	pmu_switch(struct Env *e);
+
+#endif	// !JOS_KERN_PMU_H
@@ -1,27 +1,53 @@
 // Simple implementation of cprintf console output for the kernel,
-// based on printfmt() and the kernel console's cputchar().
+// based on printfmt() and the kernel log.
 
 #include <inc/types.h>
 #include <inc/stdio.h>
 #include <inc/stdarg.h>
 
+#include <kern/klog.h>
+
+struct klogbuf {
+	int level;
+	int cnt;
+};
 
 static void
-putch(int ch, int *cnt)
+putch(int ch, struct klogbuf *b)
 {
-	cputchar(ch);
-	*cnt++;
+	klog_putc(b->level, ch);
+	b->cnt++;
 }
 
 int
-vcprintf(const char *fmt, va_list ap)
+vklogf(int level, const char *fmt, va_list ap)
+{
+	struct klogbuf b = { level, 0 };
+
+	vprintfmt((void*)putch, &b, fmt, ap);
+	klog_drain();
+	return b.cnt;
+}
+
+int
+klogf(int level, const char *fmt, ...)
 {
-	int cnt = 0;
+	va_list ap;
+	int cnt;
+
+	va_start(ap, fmt);
+	cnt = vklogf(level, fmt, ap);
+	va_end(ap);
 
-	vprintfmt((void*)putch, &cnt, fmt, ap);
 	return cnt;
 }
 
+int
+vcprintf(const char *fmt, va_list ap)
+{
+	return vklogf(KLOG_INFO, fmt, ap);
+}
+
 int
 cprintf(const char *fmt, ...)
 {
@@ -34,4 +60,3 @@ cprintf(const char *fmt, ...)
 
 	return cnt;
 }
-
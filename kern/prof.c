@@ -0,0 +1,270 @@
+// Statistical sampling profiler.
+//
+// While the profiler runs, the interval timer interrupts PROF_HZ times a
+// second.  Each tick records the interrupted eip, the current env, and
+// the return addresses of up to PROF_DEPTH callers found by following
+// the saved %ebp chain.
+//
+// Each address is resolved to its function with debuginfo_eip as the
+// sample is taken.  A user address can only be symbolized while its
+// environment's address space (and USTABDATA) is loaded, and by report
+// time the environment has usually exited.  A sample therefore stores
+// indices into a table of the functions seen so far.
+//
+// The kernel runs with interrupts disabled, so samples land in user
+// code, or in the kernel only where it enables interrupts.
+
+#include <inc/assert.h>
+#include <inc/memlayout.h>
+#include <inc/string.h>
+#include <inc/x86.h>
+
+#include <kern/env.h>
+#include <kern/kclock.h>
+#include <kern/kdebug.h>
+#include <kern/picirq.h>
+#include <kern/prof.h>
+#include <kern/usercopy.h>
+
+#define PROF_NAMELEN	32
+
+struct ProfSym {
+	uintptr_t addr;			// Function start address
+	bool user;			// In a user program?
+	char name[PROF_NAMELEN];	// Function name
+	uint32_t self;			// Samples with eip in this function
+	uint32_t total;			// Samples with it anywhere on the stack
+};
+
+struct ProfSample {
+	uintptr_t eip;			// Interrupted eip
+	envid_t env;			// Current env, or 0 in the kernel
+	uint8_t depth;			// Entries used in sym[]
+	uint16_t sym[PROF_DEPTH + 1];	// Functions, innermost first
+};
+
+static struct ProfSym syms[PROF_MAXSYMS];
+static int nsyms;
+static struct ProfSample samples[PROF_MAXSAMPLES];
+static uint32_t nsamples;
+static uint32_t ndropped;
+static bool running;
+
+// Returns the index of the function containing 'eip', adding it to the
+// symbol table if needed.  Index 0 collects addresses that could not be
+// symbolized once the table fills up.
+static int
+prof_sym(uintptr_t eip)
+{
+	struct Eipdebuginfo info;
+	bool user = eip < ULIM;
+	int i, len;
+
+	debuginfo_eip(eip, &info);
+	len = MIN(info.eip_fn_namelen, PROF_NAMELEN - 1);
+	for (i = 1; i < nsyms; i++)
+		if (syms[i].addr == info.eip_fn_addr && syms[i].user == user
+		    && strncmp(syms[i].name, info.eip_fn_name, len) == 0
+		    && syms[i].name[len] == '\0')
+			return i;
+	if (nsyms == PROF_MAXSYMS)
+		return 0;
+	syms[nsyms].addr = info.eip_fn_addr;
+	syms[nsyms].user = user;
+	memmove(syms[nsyms].name, info.eip_fn_name, len);
+	syms[nsyms].name[len] = '\0';
+	return nsyms++;
+}
+
+// Read the saved %ebp and return address of the frame at 'ebp'.
+// Returns 0 on success, < 0 if the frame is not readable.
+static int
+read_frame(uintptr_t ebp, bool user, uintptr_t frame[2])
+{
+	if (user)
+		return copyin(frame, (void *) ebp, 2 * sizeof(uintptr_t));
+	// Kernel frames all live on the kernel stack.
+	if (ebp < KSTACKTOP - KSTKSIZE || ebp > KSTACKTOP - 2 * sizeof(uintptr_t))
+		return -1;
+	memmove(frame, (void *) ebp, 2 * sizeof(uintptr_t));
+	return 0;
+}
+
+// Record one sample.  Called from the timer interrupt.
+void
+prof_tick(struct Trapframe *tf)
+{
+	struct ProfSample *s;
+	bool user = (tf->tf_cs & 3) == 3;
+	uintptr_t ebp, frame[2];
+	int i;
+
+	if (!running)
+		return;
+	if (nsamples == PROF_MAXSAMPLES) {
+		ndropped++;
+		return;
+	}
+
+	s = &samples[nsamples++];
+	s->eip = tf->tf_eip;
+	s->env = curenv ? curenv->env_id : 0;
+	s->sym[0] = prof_sym(tf->tf_eip);
+	s->depth = 1;
+
+	ebp = tf->tf_regs.reg_ebp;
+	while (s->depth <= PROF_DEPTH && ebp != 0
+	       && read_frame(ebp, user, frame) == 0 && frame[1] != 0) {
+		// frame[1] is a return address; look up the call instead.
+		s->sym[s->depth++] = prof_sym(frame[1] - 1);
+		if (frame[0] <= ebp)
+			break;
+		ebp = frame[0];
+	}
+}
+
+// Clear any previous profile and start sampling.
+void
+prof_start(void)
+{
+	nsyms = 1;
+	strcpy(syms[0].name, "<other>");
+	syms[0].addr = 0;
+	nsamples = ndropped = 0;
+	running = 1;
+	pit_init(PROF_HZ);
+	irq_enable(IRQ_TIMER);
+}
+
+void
+prof_stop(void)
+{
+	irq_disable(IRQ_TIMER);
+	running = 0;
+}
+
+bool
+prof_running(void)
+{
+	return running;
+}
+
+// Fill 'order' with the n symbol indices sorted by decreasing self
+// count, or total count if 'by_total'.
+static void
+sort_syms(uint16_t *order, int n, bool by_total)
+{
+	int i, j;
+	uint16_t t;
+
+	for (i = 0; i < n; i++)
+		order[i] = i;
+	for (i = 1; i < n; i++) {
+		t = order[i];
+		for (j = i; j > 0; j--) {
+			uint32_t a = by_total ? syms[order[j - 1]].total : syms[order[j - 1]].self;
+			uint32_t b = by_total ? syms[t].total : syms[t].self;
+			if (a >= b)
+				break;
+			order[j] = order[j - 1];
+		}
+		order[j] = t;
+	}
+}
+
+static void
+print_sym(const struct ProfSym *sym)
+{
+	cprintf("%s%s", sym->name, sym->user ? " [user]" : "");
+}
+
+// For each function, list the functions that called it and the ones
+// it called, with the number of samples on which each pair appeared.
+static void
+report_callgraph(const uint16_t *order)
+{
+	static uint32_t callers[PROF_MAXSYMS], callees[PROF_MAXSYMS];
+	const struct ProfSample *s;
+	int i, j, k, f;
+
+	cprintf("\ncall graph (samples on which caller -> callee appeared):\n");
+	for (i = 0; i < nsyms; i++) {
+		f = order[i];
+		if (syms[f].total == 0)
+			continue;
+		memset(callers, 0, sizeof(callers[0]) * nsyms);
+		memset(callees, 0, sizeof(callees[0]) * nsyms);
+		for (s = samples; s < samples + nsamples; s++)
+			for (k = 0; k < s->depth; k++) {
+				if (s->sym[k] != f)
+					continue;
+				if (k + 1 < s->depth)
+					callers[s->sym[k + 1]]++;
+				if (k > 0)
+					callees[s->sym[k - 1]]++;
+				break;
+			}
+
+		cprintf("\n");
+		for (j = 0; j < nsyms; j++)
+			if (callers[j]) {
+				cprintf("  %8u          ", callers[j]);
+				print_sym(&syms[j]);
+				cprintf("\n");
+			}
+		cprintf("  %8u %6u  * ", syms[f].total, syms[f].self);
+		print_sym(&syms[f]);
+		cprintf("\n");
+		for (j = 0; j < nsyms; j++)
+			if (callees[j]) {
+				cprintf("  %8u            -> ", callees[j]);
+				print_sym(&syms[j]);
+				cprintf("\n");
+			}
+	}
+}
+
+// Print the flat profile and, if 'callgraph', the caller/callee table.
+void
+prof_report(bool callgraph)
+{
+	static uint16_t order[PROF_MAXSYMS];
+	const struct ProfSample *s;
+	int i, k;
+
+	for (i = 0; i < nsyms; i++)
+		syms[i].self = syms[i].total = 0;
+	for (s = samples; s < samples + nsamples; s++) {
+		syms[s->sym[0]].self++;
+		// Count each function once per sample, even if recursive.
+		for (k = 0; k < s->depth; k++) {
+			int j;
+
+			for (j = 0; j < k && s->sym[j] != s->sym[k]; j++)
+				/* do nothing */;
+			if (j == k)
+				syms[s->sym[k]].total++;
+		}
+	}
+
+	cprintf("%u samples at %d Hz", nsamples, PROF_HZ);
+	if (ndropped)
+		cprintf(", %u dropped (buffer full)", ndropped);
+	cprintf("%s\n", running ? " (still running)" : "");
+	if (nsamples == 0)
+		return;
+
+	sort_syms(order, nsyms, 0);
+	cprintf("\n  %%self   self  total  function\n");
+	for (i = 0; i < nsyms && syms[order[i]].self; i++) {
+		cprintf("  %4u%% %6u %6u  ", syms[order[i]].self * 100 / nsamples,
+			syms[order[i]].self, syms[order[i]].total);
+		print_sym(&syms[order[i]]);
+		cprintf("\n");
+	}
+
+	if (callgraph) {
+		sort_syms(order, nsyms, 1);
+		report_callgraph(order);
+	}
+}
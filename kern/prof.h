@@ -0,0 +1,22 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_PROF_H
+#define JOS_KERN_PROF_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/trap.h>
+
+#define PROF_HZ		1000	// Timer ticks (samples) per second
+#define PROF_MAXSAMPLES	8192	// Samples kept per profile
+#define PROF_DEPTH	4	// Callers recorded per sample
+#define PROF_MAXSYMS	512	// Distinct functions per profile
+
+void	prof_start(void);
+void	prof_stop(void);
+bool	prof_running(void);
+void	prof_tick(struct Trapframe *tf);
+void	prof_report(bool callgraph);
+
+#endif	// !JOS_KERN_PROF_H
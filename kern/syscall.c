@@ -10,6 +10,8 @@
 #include <kern/trap.h>
 #include <kern/syscall.h>
 #include <kern/console.h>
+#include <kern/sched.h>
+#include <kern/usercopy.h>
 
 // Print a string to the system console.
 // The string is exactly 'len' characters long.
@@ -17,10 +19,20 @@
 static void
 sys_cputs(const char *s, size_t len)
 {
-	// Check that the user has permission to read memory [s, s+len).
-	// Destroy the environment if not.
+	static char buf[PGSIZE];
 
-	// LAB 3: Your code here.
+	// Check that the user has permission to read memory [s, s+len).
+	// Destroy the environment if not.  Short strings are copied in
+	// optimistically; user_mem_assert only runs to report a fault, or
+	// up front for strings too long to buffer, which must not be
+	// partially printed.
+	if (len > sizeof(buf)) {
+		user_mem_assert(curenv, s, len, PTE_U);
+	} else if (copyin(buf, s, len) < 0) {
+		user_mem_assert(curenv, s, len, PTE_U);
+		return;
+	} else
+		s = buf;
 
 	// Print the string supplied by the user.
 	cprintf("%.*s", len, s);
@@ -34,6 +46,22 @@ sys_cgetc(void)
 	return cons_getc();
 }
 
+// Read a character from the system console, blocking until there is
+// one.  The env sleeps until the keyboard or serial interrupt brings
+// input, which cons_wakeup hands it as the syscall's return value.
+// Returns the character.
+static int
+sys_cgetc_wait(void)
+{
+	int c;
+
+	if ((c = cons_getc()) != 0)
+		return c;
+	curenv->env_cons_wait = 1;
+	curenv->env_status = ENV_NOT_RUNNABLE;
+	sched_yield();
+}
+
 // Returns the current environment's envid.
 static envid_t
 sys_getenvid(void)
@@ -62,6 +90,298 @@ sys_env_destroy(envid_t envid)
 	return 0;
 }
 
+// Deschedule current environment and pick a different one to run.
+static void
+sys_yield(void)
+{
+	sched_yield();
+}
+
+// Create a new environment running the program 'name', one of the
+// user programs linked into the kernel (see env_spawn).
+// The new environment is a child of the caller and is runnable.
+//
+// If 'argv' is not NULL, it is a NULL-terminated array of at most
+// ENV_MAXARGS strings, which the new environment receives as umain's
+// argc and argv.  The strings must fit in one page together.
+//
+// Returns envid of new environment, or < 0 on error.  Errors are:
+//	-E_INVAL if 'name' or the arguments are too long.
+//	-E_FAULT if 'name', 'argv' or an argument is not readable.
+//	-E_NOT_FOUND if there is no program called 'name'.
+//	-E_NOT_EXEC if the program image is not a valid executable.
+//	-E_NO_FREE_ENV if no free environment is available.
+//	-E_NO_MEM on memory exhaustion.
+static envid_t
+sys_spawn(const char *name, const char **argv)
+{
+	static char argbuf[PGSIZE];
+	const char *kargv[ENV_MAXARGS + 1];
+	char kname[ENV_NAME_MAX];
+	size_t used = 0;
+	struct Env *e;
+	int argc, r;
+
+	if ((r = strncpy_from_user(kname, name, sizeof(kname))) < 0)
+		return r;
+
+	for (argc = 0; argv; argc++) {
+		const char *arg;
+
+		if ((r = copyin(&arg, &argv[argc], sizeof(arg))) < 0)
+			return r;
+		if (!arg)
+			break;
+		if (argc == ENV_MAXARGS)
+			return -E_INVAL;
+		if ((r = strncpy_from_user(argbuf + used, arg, sizeof(argbuf) - used)) < 0)
+			return r;
+		kargv[argc] = argbuf + used;
+		used += r + 1;
+	}
+	kargv[argc] = NULL;
+
+	if ((r = env_spawn(kname, argv ? kargv : NULL, curenv->env_id, &e)) < 0)
+		return r;
+	return e->env_id;
+}
+
+// Set the page fault upcall for 'envid' by modifying the corresponding struct
+// Env's 'env_pgfault_upcall' field.  When 'envid' causes a page fault, the
+// kernel will push a fault record onto the exception stack, then branch to
+// 'func'.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist,
+//		or the caller doesn't have permission to change envid.
+static int
+sys_env_set_pgfault_upcall(envid_t envid, void *func)
+{
+	struct Env *e;
+	int r;
+
+	if ((r = envid2env(envid, &e, 1)) < 0)
+		return r;
+	e->env_pgfault_upcall = func;
+	return 0;
+}
+
+// Allocate a page of memory and map it at 'va' with permission
+// 'perm' in the address space of 'envid'.
+// The page's contents are set to 0.
+// If a page is already mapped at 'va', that page is unmapped as a
+// side effect.
+//
+// perm -- PTE_U | PTE_P must be set, PTE_AVAIL | PTE_W may or may not be set,
+//         but no other bits may be set.  See PTE_SYSCALL in inc/mmu.h.
+//
+// Return 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist,
+//		or the caller doesn't have permission to change envid.
+//	-E_INVAL if va >= UTOP, or va is not page-aligned.
+//	-E_INVAL if perm is inappropriate (see above).
+//	-E_NO_MEM if there's no memory to allocate the new page,
+//		or to allocate any necessary page tables.
+static int
+sys_page_alloc(envid_t envid, void *va, int perm)
+{
+	struct PageInfo *pp;
+	struct Env *e;
+	int r;
+
+	if ((r = envid2env(envid, &e, 1)) < 0)
+		return r;
+	if ((uintptr_t) va >= UTOP || PGOFF(va))
+		return -E_INVAL;
+	if ((perm & (PTE_U | PTE_P)) != (PTE_U | PTE_P) || (perm & ~PTE_SYSCALL))
+		return -E_INVAL;
+
+	if (!(pp = page_alloc(ALLOC_ZERO)))
+		return -E_NO_MEM;
+	if ((r = page_insert(e->env_pgdir, pp, va, perm)) < 0) {
+		page_free(pp);
+		return r;
+	}
+	return 0;
+}
+
+// Map the page of memory at 'srcva' in srcenvid's address space
+// at 'dstva' in dstenvid's address space with permission 'perm'.
+// Perm has the same restrictions as in sys_page_alloc, except
+// that it also must not grant write access to a read-only
+// page.
+//
+// Return 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if srcenvid and/or dstenvid doesn't currently exist,
+//		or the caller doesn't have permission to change one of them.
+//	-E_INVAL if srcva >= UTOP or srcva is not page-aligned,
+//		or dstva >= UTOP or dstva is not page-aligned.
+//	-E_INVAL is srcva is not mapped in srcenvid's address space.
+//	-E_INVAL if perm is inappropriate (see sys_page_alloc).
+//	-E_INVAL if (perm & PTE_W), but srcva is read-only in srcenvid's
+//		address space.
+//	-E_NO_MEM if there's no memory to allocate any necessary page tables.
+static int
+sys_page_map(envid_t srcenvid, void *srcva,
+	     envid_t dstenvid, void *dstva, int perm)
+{
+	struct Env *srcenv, *dstenv;
+	struct PageInfo *pp;
+	pte_t *pte;
+	int r;
+
+	if ((r = envid2env(srcenvid, &srcenv, 1)) < 0
+	    || (r = envid2env(dstenvid, &dstenv, 1)) < 0)
+		return r;
+	if ((uintptr_t) srcva >= UTOP || PGOFF(srcva)
+	    || (uintptr_t) dstva >= UTOP || PGOFF(dstva))
+		return -E_INVAL;
+	if ((perm & (PTE_U | PTE_P)) != (PTE_U | PTE_P) || (perm & ~PTE_SYSCALL))
+		return -E_INVAL;
+
+	if (!(pp = page_lookup(srcenv->env_pgdir, srcva, &pte)))
+		return -E_INVAL;
+	if ((perm & PTE_W) && !(*pte & PTE_W))
+		return -E_INVAL;
+	return page_insert(dstenv->env_pgdir, pp, dstva, perm);
+}
+
+// Unmap the page of memory at 'va' in the address space of 'envid'.
+// If no page is mapped, the function silently succeeds.
+//
+// Return 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist,
+//		or the caller doesn't have permission to change envid.
+//	-E_INVAL if va >= UTOP, or va is not page-aligned.
+static int
+sys_page_unmap(envid_t envid, void *va)
+{
+	struct Env *e;
+	int r;
+
+	if ((r = envid2env(envid, &e, 1)) < 0)
+		return r;
+	if ((uintptr_t) va >= UTOP || PGOFF(va))
+		return -E_INVAL;
+	page_remove(e->env_pgdir, va);
+	return 0;
+}
+
+// Try to send 'value' to the target env 'envid'.
+// If srcva < UTOP, then also send page currently mapped at 'srcva',
+// so that receiver gets a duplicate mapping of the same page.
+//
+// The send fails with a return value of -E_IPC_NOT_RECV if the
+// target is not blocked, waiting for an IPC.
+//
+// Otherwise, the send succeeds, and the target's ipc fields are
+// updated as follows:
+//    env_ipc_recving is set to 0 to block future sends;
+//    env_ipc_from is set to the sending envid;
+//    env_ipc_value is set to the 'value' parameter;
+//    env_ipc_perm is set to 'perm' if a page was transferred, 0 otherwise.
+// The target environment is marked runnable again, returning 0
+// from the paused sys_ipc_recv system call.
+//
+// If the sender wants to send a page but the receiver isn't asking for one,
+// then no page mapping is transferred, but no error occurs.
+// The ipc only happens when no errors occur.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist.
+//		(No need to check permissions.)
+//	-E_IPC_NOT_RECV if envid is not currently blocked in sys_ipc_recv,
+//		or another environment managed to send first.
+//	-E_INVAL if srcva < UTOP but srcva is not page-aligned.
+//	-E_INVAL if srcva < UTOP and perm is inappropriate
+//		(see sys_page_alloc).
+//	-E_INVAL if srcva < UTOP but srcva is not mapped in the caller's
+//		address space.
+//	-E_INVAL if (perm & PTE_W), but srcva is read-only in the
+//		current environment's address space.
+//	-E_NO_MEM if there's not enough memory to map srcva in envid's
+//		address space.
+static int
+sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
+{
+	struct PageInfo *pp;
+	struct Env *e;
+	pte_t *pte;
+	int r;
+
+	if ((r = envid2env(envid, &e, 0)) < 0)
+		return r;
+	if (!e->env_ipc_recving)
+		return -E_IPC_NOT_RECV;
+
+	e->env_ipc_perm = 0;
+	if ((uintptr_t) srcva < UTOP) {
+		if (PGOFF(srcva))
+			return -E_INVAL;
+		if ((perm & (PTE_U | PTE_P)) != (PTE_U | PTE_P) || (perm & ~PTE_SYSCALL))
+			return -E_INVAL;
+		if (!(pp = page_lookup(curenv->env_pgdir, srcva, &pte)))
+			return -E_INVAL;
+		if ((perm & PTE_W) && !(*pte & PTE_W))
+			return -E_INVAL;
+		if ((uintptr_t) e->env_ipc_dstva < UTOP) {
+			if ((r = page_insert(e->env_pgdir, pp, e->env_ipc_dstva, perm)) < 0)
+				return r;
+			e->env_ipc_perm = perm;
+		}
+	}
+
+	e->env_ipc_recving = 0;
+	e->env_ipc_from = curenv->env_id;
+	e->env_ipc_value = value;
+	e->env_tf.tf_regs.reg_eax = 0;
+	e->env_status = ENV_RUNNABLE;
+	return 0;
+}
+
+// Block until a value is ready.  Record that you want to receive
+// using the env_ipc_recving and env_ipc_dstva fields of struct Env,
+// mark yourself not runnable, and then give up the CPU.
+//
+// If 'dstva' is < UTOP, then you are willing to receive a page of data.
+// 'dstva' is the virtual address at which the sent page should be mapped.
+//
+// This function only returns on error, but the system call will eventually
+// return 0 on success.
+// Return < 0 on error.  Errors are:
+//	-E_INVAL if dstva < UTOP but dstva is not page-aligned.
+static int
+sys_ipc_recv(void *dstva)
+{
+	if ((uintptr_t) dstva < UTOP && PGOFF(dstva))
+		return -E_INVAL;
+
+	curenv->env_ipc_recving = 1;
+	curenv->env_ipc_dstva = dstva;
+	curenv->env_status = ENV_NOT_RUNNABLE;
+	sched_yield();
+}
+
+// Block until hardware interrupt 'irq' fires, unmasking it at the PIC
+// the first time.  If it fired since the caller last waited, return at
+// once.  This lets user-level drivers sleep instead of polling.
+//
+// Returns 0 once the interrupt has fired, < 0 on error.  Errors are:
+//	-E_BAD_ENV if the caller is not a driver (the file system server).
+//	-E_INVAL if 'irq' is not one that user-level drivers handle.
+static int
+sys_irq_wait(int irq)
+{
+	if (curenv->env_type != ENV_TYPE_FS)
+		return -E_BAD_ENV;
+	if (irq != IRQ_IDE)
+		return -E_INVAL;
+
+	if (irq_wait(curenv, irq))
+		return 0;
+	sched_yield();
+}
+
 // Dispatches to the correct kernel function, passing the arguments.
 int32_t
 syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5)
@@ -80,6 +400,28 @@ syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
                 return sys_getenvid();
             case SYS_env_destroy:
                 return sys_env_destroy((envid_t)a1);
+            case SYS_yield:
+                sys_yield();
+                return 0;
+            case SYS_spawn:
+                return sys_spawn((const char *)a1, (const char **)a2);
+            case SYS_page_alloc:
+                return sys_page_alloc((envid_t)a1, (void *)a2, (int)a3);
+            case SYS_page_map:
+                return sys_page_map((envid_t)a1, (void *)a2,
+                                    (envid_t)a3, (void *)a4, (int)a5);
+            case SYS_page_unmap:
+                return sys_page_unmap((envid_t)a1, (void *)a2);
+            case SYS_env_set_pgfault_upcall:
+                return sys_env_set_pgfault_upcall((envid_t)a1, (void *)a2);
+            case SYS_ipc_try_send:
+                return sys_ipc_try_send((envid_t)a1, a2, (void *)a3, (unsigned)a4);
+            case SYS_ipc_recv:
+                return sys_ipc_recv((void *)a1);
+            case SYS_irq_wait:
+                return sys_irq_wait((int)a1);
+            case SYS_cgetc_wait:
+                return sys_cgetc_wait();
             default:
 		return -E_INVAL;
 	}
@@ -1,12 +1,17 @@
 #include <inc/mmu.h>
 #include <inc/x86.h>
 #include <inc/assert.h>
+#include <inc/error.h>
 
 #include <kern/pmap.h>
 #include <kern/trap.h>
 #include <kern/console.h>
 #include <kern/monitor.h>
 #include <kern/env.h>
+#include <kern/usercopy.h>
+#include <kern/picirq.h>
+#include <kern/prof.h>
+#include <kern/fpu.h>
 #include <kern/syscall.h>
 
 static struct Taskstate ts;
@@ -55,6 +60,8 @@ static const char *trapname(int trapno)
 		return excnames[trapno];
 	if (trapno == T_SYSCALL)
 		return "System call";
+	if (trapno >= IRQ_OFFSET && trapno < IRQ_OFFSET + 16)
+		return "Hardware Interrupt";
         else if (trapno == T_DEFAULT)
             return "Default";
 	return "(unknown trap)";
@@ -97,6 +104,11 @@ trap_init(void)
     void t_align();
     void t_mchk();
     void t_simderr();
+    void t_irq_timer();
+    void t_irq_kbd();
+    void t_irq_serial();
+    void t_irq_spurious();
+    void t_irq_ide();
     void t_syscall();
     void t_default();
 
@@ -120,6 +132,11 @@ trap_init(void)
     SETGATE_F(T_ALIGN, t_align);
     SETGATE_F(T_MCHK, t_mchk);
     SETGATE_F(T_SIMDERR, t_simderr);
+    SETGATE_F(IRQ_OFFSET + IRQ_TIMER, t_irq_timer);
+    SETGATE_F(IRQ_OFFSET + IRQ_KBD, t_irq_kbd);
+    SETGATE_F(IRQ_OFFSET + IRQ_SERIAL, t_irq_serial);
+    SETGATE_F(IRQ_OFFSET + IRQ_SPURIOUS, t_irq_spurious);
+    SETGATE_F(IRQ_OFFSET + IRQ_IDE, t_irq_ide);
     SETGATE(idt[(T_SYSCALL)], 0, GD_KT, (t_syscall), 3);
     SETGATE_F(T_DEFAULT, t_default);
 
@@ -205,6 +222,9 @@ trap_dispatch(struct Trapframe *tf)
         if (tf->tf_trapno == T_PGFLT) {
             page_fault_handler(tf);
             return;
+        } else if (tf->tf_trapno == T_DEVICE && (tf->tf_cs & 3) == 3) {
+            fpu_trap();
+            return;
         } else if (tf->tf_trapno == T_BRKPT) {
             monitor(tf);
             return;
@@ -213,6 +233,44 @@ trap_dispatch(struct Trapframe *tf)
             return;
         }
 
+	// Handle spurious interrupts
+	// The hardware sometimes raises these because of noise on the
+	// IRQ line or other reasons. We don't care.
+	if (tf->tf_trapno == IRQ_OFFSET + IRQ_SPURIOUS) {
+		cprintf("Spurious interrupt on irq 7\n");
+		print_trapframe(tf);
+		return;
+	}
+
+	// The timer only runs while the profiler is sampling.
+	if (tf->tf_trapno == IRQ_OFFSET + IRQ_TIMER) {
+		irq_eoi();
+		prof_tick(tf);
+		return;
+	}
+
+	// Console input: move it into the console buffer and hand it to
+	// any env waiting for it.
+	if (tf->tf_trapno == IRQ_OFFSET + IRQ_KBD) {
+		irq_eoi();
+		kbd_intr();
+		cons_wakeup();
+		return;
+	}
+	if (tf->tf_trapno == IRQ_OFFSET + IRQ_SERIAL) {
+		irq_eoi();
+		serial_intr();
+		cons_wakeup();
+		return;
+	}
+
+	// Device interrupts handled by user-level drivers.
+	if (tf->tf_trapno == IRQ_OFFSET + IRQ_IDE) {
+		irq_eoi();
+		irq_signal(IRQ_IDE);
+		return;
+	}
+
 	// Unexpected trap: The user process or the kernel has a bug.
 	print_trapframe(tf);
 	if (tf->tf_cs == GD_KT)
@@ -223,6 +281,61 @@ trap_dispatch(struct Trapframe *tf)
 	}
 }
 
+// IRQs that fired while no env was waiting for them.
+static uint16_t irq_pending;
+
+// Block e until hardware interrupt 'irq' fires.  If it already fired
+// since the last wait, consume that instead and return 1 without
+// blocking; otherwise mark e not runnable and return 0.
+int
+irq_wait(struct Env *e, int irq)
+{
+	if (irq_pending & (1 << irq)) {
+		irq_pending &= ~(1 << irq);
+		return 1;
+	}
+	irq_enable(irq);
+	e->env_irq_wait = irq;
+	e->env_status = ENV_NOT_RUNNABLE;
+	return 0;
+}
+
+// Wake the env waiting for 'irq', or remember the interrupt for the
+// next irq_wait if there is none.
+void
+irq_signal(int irq)
+{
+	int i;
+
+	for (i = 0; i < NENV; i++)
+		if (envs[i].env_status == ENV_NOT_RUNNABLE
+		    && envs[i].env_irq_wait == irq) {
+			envs[i].env_irq_wait = -1;
+			envs[i].env_tf.tf_regs.reg_eax = 0;
+			envs[i].env_status = ENV_RUNNABLE;
+			return;
+		}
+	irq_pending |= 1 << irq;
+}
+
+// Give buffered console input to the envs blocked in sys_cgetc_wait,
+// one character each, as the return value of that call.
+void
+cons_wakeup(void)
+{
+	int i, c;
+
+	for (i = 0; i < NENV; i++)
+		if (envs[i].env_status == ENV_NOT_RUNNABLE
+		    && envs[i].env_cons_wait) {
+			if ((c = cons_getc()) == 0)
+				return;
+			envs[i].env_cons_wait = 0;
+			envs[i].env_tf.tf_regs.reg_eax = c;
+			envs[i].env_status = ENV_RUNNABLE;
+		}
+}
+
 void
 trap(struct Trapframe *tf)
 {
@@ -235,7 +348,9 @@ trap(struct Trapframe *tf)
 	// the interrupt path.
 	assert(!(read_eflags() & FL_IF));
 
-	cprintf("Incoming TRAP frame at %p\n", tf);
+	// Don't report device interrupts; there are far too many.
+	if (tf->tf_trapno < IRQ_OFFSET || tf->tf_trapno >= IRQ_OFFSET + MAX_IRQS)
+		cprintf("Incoming TRAP frame at %p\n", tf);
 
 	if ((tf->tf_cs & 3) == 3) {
 		// Trapped from user mode.
@@ -256,12 +371,35 @@ trap(struct Trapframe *tf)
 	// Dispatch based on what type of trap occurred
 	trap_dispatch(tf);
 
+	// A fault in the kernel that was fixed up above resumes the
+	// interrupted kernel code, not the environment.
+	if ((tf->tf_cs & 3) == 0)
+		env_pop_tf(tf);
+
 	// Return to the current environment, which should be running.
 	assert(curenv && curenv->env_status == ENV_RUNNING);
 	env_run(curenv);
 }
 
 
+// Map a zeroed page at the stack page containing 'va' in env e.
+// Returns 0 on success, -E_NO_MEM if no page could be allocated.
+static int
+user_stack_grow(struct Env *e, uintptr_t va)
+{
+	struct PageInfo *pp;
+	int r;
+
+	if (!(pp = page_alloc(ALLOC_ZERO)))
+		return -E_NO_MEM;
+	if ((r = page_insert(e->env_pgdir, pp, (void *) ROUNDDOWN(va, PGSIZE),
+			     PTE_P | PTE_U | PTE_W)) < 0) {
+		page_free(pp);
+		return r;
+	}
+	return 0;
+}
+
 void
 page_fault_handler(struct Trapframe *tf)
 {
@@ -270,13 +408,84 @@ page_fault_handler(struct Trapframe *tf)
 	// Read processor's CR2 register to find the faulting address
 	fault_va = rcr2();
 
-	// Handle kernel-mode page faults.
-
-	// LAB 3: Your code here.
+	// Handle kernel-mode page faults.  The only kernel code allowed to
+	// fault is the user-copy code listed in the exception table; let it
+	// grow the user stack like the user could, and otherwise resume at
+	// its fixup so it returns -E_FAULT.
+	if ((tf->tf_cs & 3) == 0) {
+		uintptr_t fixup = extable_fixup(tf->tf_eip);
+
+		if (!fixup) {
+			print_trapframe(tf);
+			panic("kernel page fault va %08x ip %08x",
+			      fault_va, tf->tf_eip);
+		}
+		if (!(tf->tf_err & FEC_PR) && curenv
+		    && fault_va >= USTACKBOT && fault_va < USTACKTOP
+		    && user_stack_grow(curenv, fault_va) == 0)
+			return;
+		tf->tf_eip = fixup;
+		return;
+	}
 
 	// We've already handled kernel-mode exceptions, so if we get here,
 	// the page fault happened in user mode.
 
+	// The normal user stack starts out as a single page and is grown
+	// on demand: map a zeroed page for any not-present fault inside
+	// [USTACKBOT, USTACKTOP) and retry the faulting instruction.
+	if ((tf->tf_err & (FEC_U | FEC_PR)) == FEC_U
+	    && fault_va >= USTACKBOT && fault_va < USTACKTOP) {
+		if (user_stack_grow(curenv, fault_va) == 0)
+			return;
+		cprintf("[%08x] out of memory growing stack to va %08x\n",
+			curenv->env_id, fault_va);
+		env_destroy(curenv);
+		return;
+	}
+
+	// Call the environment's page fault upcall, if one exists.  Set up a
+	// page fault stack frame on the user exception stack (below
+	// UXSTACKTOP), then branch to curenv->env_pgfault_upcall.
+	//
+	// The page fault upcall might cause another page fault, in which case
+	// we branch to the page fault upcall recursively, pushing another
+	// page fault stack frame on top of the user exception stack.  The
+	// trap handler needs one word of scratch space at the top of the
+	// trap-time stack in order to return, so that word is left empty
+	// between the frames.
+	//
+	// If there's no page fault upcall, the environment didn't allocate a
+	// page for its exception stack or can't write to it, or the exception
+	// stack overflows, then destroy the environment that caused the fault.
+	// user_mem_assert catches the last three, since the page below the
+	// exception stack is never mapped.
+	if (curenv->env_pgfault_upcall) {
+		struct UTrapframe *utf;
+
+		if (tf->tf_esp >= UXSTACKTOP - PGSIZE && tf->tf_esp < UXSTACKTOP)
+			utf = (struct UTrapframe *) (tf->tf_esp - 4) - 1;
+		else
+			utf = (struct UTrapframe *) UXSTACKTOP - 1;
+		user_mem_assert(curenv, utf, sizeof(*utf), PTE_W);
+
+		utf->utf_fault_va = fault_va;
+		utf->utf_err = tf->tf_err;
+		utf->utf_regs = tf->tf_regs;
+		utf->utf_eip = tf->tf_eip;
+		utf->utf_eflags = tf->tf_eflags;
+		utf->utf_esp = tf->tf_esp;
+
+		tf->tf_eip = (uintptr_t) curenv->env_pgfault_upcall;
+		tf->tf_esp = (uintptr_t) utf;
+		return;
+	}
+
+	// The guard page below the stack region is never mapped.
+	if (fault_va >= USTACKBOT - PGSIZE && fault_va < USTACKBOT)
+		cprintf("[%08x] user stack overflow va %08x ip %08x\n",
+			curenv->env_id, fault_va, tf->tf_eip);
+
 	// Destroy the environment that caused the fault.
 	cprintf("[%08x] user fault va %08x ip %08x\n",
 		curenv->env_id, fault_va, tf->tf_eip);
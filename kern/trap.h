@@ -9,6 +9,8 @@
 #include <inc/trap.h>
 #include <inc/mmu.h>
 
+struct Env;
+
 /* The kernel's interrupt descriptor table */
 extern struct Gatedesc idt[];
 extern struct Pseudodesc idt_pd;
@@ -18,6 +20,9 @@ void trap_init_percpu(void);
 void print_regs(struct PushRegs *regs);
 void print_trapframe(struct Trapframe *tf);
 void page_fault_handler(struct Trapframe *);
+int irq_wait(struct Env *e, int irq);
+void irq_signal(int irq);
+void cons_wakeup(void);
 void backtrace(struct Trapframe *);
 
 #endif /* JOS_KERN_TRAP_H */
@@ -0,0 +1,125 @@
+// Copying between kernel and user memory.
+//
+// These routines don't check page permissions up front.  They only make
+// sure the user range lies below ULIM and then copy optimistically with
+// 'rep movs'.  Each instruction that touches user memory has an entry in
+// the __ex_table section; if it page faults, page_fault_handler resumes
+// at the entry's fixup label, which makes the routine return -E_FAULT.
+// A valid pointer therefore costs no more than a memcpy.
+//
+// The kernel runs with CR0_WP set, so copyout also faults on pages the
+// user may not write, such as UENVS and UPAGES.
+
+#include <inc/memlayout.h>
+#include <inc/error.h>
+
+#include <kern/usercopy.h>
+
+extern const struct ExTableEntry __EX_TABLE_BEGIN__[];
+extern const struct ExTableEntry __EX_TABLE_END__[];
+
+// Is [va, va+len) a range the user could own?
+static bool
+user_range_ok(const void *va, size_t len)
+{
+	uintptr_t start = (uintptr_t) va;
+
+	return start + len >= start && start + len <= ULIM;
+}
+
+static int
+fault_copy(void *dst, const void *src, size_t len)
+{
+	int r;
+
+	asm volatile("	movl %%ecx, %%edx\n"
+		     "	shrl $2, %%ecx\n"
+		     "1:	rep movsl\n"
+		     "	movl %%edx, %%ecx\n"
+		     "	andl $3, %%ecx\n"
+		     "2:	rep movsb\n"
+		     "	xorl %0, %0\n"
+		     "	jmp 4f\n"
+		     "3:	movl %4, %0\n"
+		     "4:\n"
+		     ".pushsection __ex_table, \"a\"\n"
+		     "	.long 1b, 3b\n"
+		     "	.long 2b, 3b\n"
+		     ".popsection\n"
+		     : "=&a" (r), "+D" (dst), "+S" (src), "+c" (len)
+		     : "i" (-E_FAULT)
+		     : "edx", "memory", "cc");
+	return r;
+}
+
+// Copy 'len' bytes from user address 'usrc' to kernel address 'dst'.
+// Returns 0 on success, -E_FAULT if any part of 'usrc' is not readable.
+int
+copyin(void *dst, const void *usrc, size_t len)
+{
+	if (!user_range_ok(usrc, len))
+		return -E_FAULT;
+	return fault_copy(dst, usrc, len);
+}
+
+// Copy 'len' bytes from kernel address 'src' to user address 'udst'.
+// Returns 0 on success, -E_FAULT if any part of 'udst' is not writable.
+int
+copyout(void *udst, const void *src, size_t len)
+{
+	if (!user_range_ok(udst, len))
+		return -E_FAULT;
+	return fault_copy(udst, src, len);
+}
+
+// Copy the NUL-terminated user string 'usrc' into the kernel buffer
+// 'dst', which has room for 'size' bytes including the terminator.
+//
+// Returns the length of the string, not counting the NUL, or
+//	-E_FAULT if the string is not readable.
+//	-E_INVAL if the string does not fit in 'size' bytes.
+int
+strncpy_from_user(char *dst, const char *usrc, size_t size)
+{
+	char *d = dst;
+	int r;
+
+	asm volatile("	movl %5, %0\n"
+		     "	testl %%ecx, %%ecx\n"
+		     "	jz 5f\n"
+		     "1:	cmpl %4, %%esi\n"
+		     "	jae 3f\n"
+		     "2:	lodsb\n"
+		     "	stosb\n"
+		     "	testb %%al, %%al\n"
+		     "	jz 4f\n"
+		     "	decl %%ecx\n"
+		     "	jnz 1b\n"
+		     "	jmp 5f\n"
+		     "3:	movl %6, %0\n"
+		     "	jmp 5f\n"
+		     "4:	xorl %0, %0\n"
+		     "5:\n"
+		     ".pushsection __ex_table, \"a\"\n"
+		     "	.long 2b, 3b\n"
+		     ".popsection\n"
+		     : "=&d" (r), "+D" (d), "+S" (usrc), "+c" (size)
+		     : "i" (ULIM), "i" (-E_INVAL), "i" (-E_FAULT)
+		     : "eax", "memory", "cc");
+	if (r < 0)
+		return r;
+	return d - dst - 1;
+}
+
+// Returns the fixup address for a page fault at kernel instruction
+// 'eip', or 0 if 'eip' is not allowed to fault.
+uintptr_t
+extable_fixup(uintptr_t eip)
+{
+	const struct ExTableEntry *x;
+
+	for (x = __EX_TABLE_BEGIN__; x < __EX_TABLE_END__; x++)
+		if (x->insn == eip)
+			return x->fixup;
+	return 0;
+}
@@ -0,0 +1,24 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_USERCOPY_H
+#define JOS_KERN_USERCOPY_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+// An exception table entry: if the instruction at 'insn' page faults,
+// resume at 'fixup' instead of treating it as a kernel bug.
+struct ExTableEntry {
+	uintptr_t insn;
+	uintptr_t fixup;
+};
+
+int	copyin(void *dst, const void *usrc, size_t len);
+int	copyout(void *udst, const void *src, size_t len);
+int	strncpy_from_user(char *dst, const char *usrc, size_t size);
+
+uintptr_t extable_fixup(uintptr_t eip);
+
+#endif	// !JOS_KERN_USERCOPY_H
@@ -15,11 +15,8 @@ cputchar(int ch)
 int
 getchar(void)
 {
-	int r;
-	// sys_cgetc does not block, but getchar should.
-	while ((r = sys_cgetc()) == 0)
-		;
-	return r;
+	// Sleep in the kernel until a key arrives rather than poll.
+	return sys_cgetc_wait();
 }
 
 
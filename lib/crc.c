@@ -0,0 +1,129 @@
+// Checksums shared by the kernel and user environments.
+//
+// crc32c uses the SSE4.2 crc32 instruction when CPUID reports it.
+// Otherwise it falls back to slicing-by-8: eight 256-entry tables let
+// the loop fold in eight bytes per iteration with independent lookups,
+// instead of one byte per dependent lookup.  The tables are built on
+// first use.
+
+#include <inc/crc.h>
+#include <inc/x86.h>
+
+#define CRC32C_POLY		0x82f63b78	// Castagnoli, bit-reflected
+#define CPUID_ECX_SSE42		(1 << 20)
+
+typedef uint32_t __attribute__((may_alias)) word_t;
+typedef uint16_t __attribute__((may_alias)) half_t;
+
+static uint32_t crc_table[8][256];
+static bool crc_table_ready;
+static int has_sse42 = -1;		// -1 until first checked
+
+static void
+crc_table_init(void)
+{
+	uint32_t crc;
+	int i, j, k;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLY : 0);
+		crc_table[0][i] = crc;
+	}
+	for (i = 0; i < 256; i++)
+		for (k = 1; k < 8; k++)
+			crc_table[k][i] = (crc_table[k - 1][i] >> 8)
+				^ crc_table[0][crc_table[k - 1][i] & 0xff];
+	crc_table_ready = 1;
+}
+
+uint32_t
+crc32c_sw(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	uint32_t lo, hi;
+
+	if (!crc_table_ready)
+		crc_table_init();
+
+	crc = ~crc;
+	for (; len > 0 && ((uint32_t) p & 3); len--)
+		crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	for (; len >= 8; len -= 8, p += 8) {
+		lo = *(const word_t *) p ^ crc;
+		hi = *(const word_t *) (p + 4);
+		crc = crc_table[7][lo & 0xff]
+			^ crc_table[6][(lo >> 8) & 0xff]
+			^ crc_table[5][(lo >> 16) & 0xff]
+			^ crc_table[4][lo >> 24]
+			^ crc_table[3][hi & 0xff]
+			^ crc_table[2][(hi >> 8) & 0xff]
+			^ crc_table[1][(hi >> 16) & 0xff]
+			^ crc_table[0][hi >> 24];
+	}
+	for (; len > 0; len--)
+		crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+uint32_t
+crc32c_hw(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+
+	crc = ~crc;
+	for (; len > 0 && ((uint32_t) p & 3); len--)
+		asm("crc32b %1, %0" : "+r" (crc) : "rm" (*p++));
+	for (; len >= 8; len -= 8, p += 8)
+		asm("crc32l %1, %0\n"
+		    "crc32l %2, %0"
+		    : "+r" (crc)
+		    : "rm" (*(const word_t *) p), "rm" (*(const word_t *) (p + 4)));
+	for (; len > 0; len--)
+		asm("crc32b %1, %0" : "+r" (crc) : "rm" (*p++));
+	return ~crc;
+}
+
+bool
+crc32c_hw_supported(void)
+{
+	uint32_t ecx;
+
+	if (has_sse42 < 0) {
+		cpuid(1, NULL, NULL, &ecx, NULL);
+		has_sse42 = (ecx & CPUID_ECX_SSE42) != 0;
+	}
+	return has_sse42;
+}
+
+uint32_t
+crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	if (crc32c_hw_supported())
+		return crc32c_hw(crc, buf, len);
+	return crc32c_sw(crc, buf, len);
+}
+
+// Sum 32 bits at a time into a 64-bit accumulator; ones' complement
+// addition is associative, so folding the carries down to 16 bits at
+// the end gives the same result as a 16-bit sum.
+uint16_t
+inet_checksum(const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	uint64_t sum = 0;
+
+	for (; len >= 4; len -= 4, p += 4)
+		sum += *(const word_t *) p;
+	if (len >= 2) {
+		sum += *(const half_t *) p;
+		len -= 2;
+		p += 2;
+	}
+	if (len)
+		sum += *p;
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return ~sum;
+}
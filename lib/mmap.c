@@ -0,0 +1,102 @@
+// Memory-mapped files.
+//
+// mmap asks the file's device for each page of the file in turn and
+// has it mapped straight into our address space; for files, those are
+// the file server's block cache pages, so reading a mapped file copies
+// nothing and every env mapping the same file shares one physical copy.
+// MAP_PRIVATE mappings are marked copy-on-write, and the first write
+// to such a page gives this env its own copy.
+
+#include <inc/lib.h>
+
+// PTE_COW marks copy-on-write page table entries.
+// It is one of the bits explicitly allocated to user processes (PTE_AVAIL).
+#define PTE_COW		0x800
+
+// Give this env a private, writable copy of the copy-on-write page
+// that faulted.  Any other fault is fatal.
+static void
+mmap_pgfault(struct UTrapframe *utf)
+{
+	void *addr = ROUNDDOWN((void *) utf->utf_fault_va, PGSIZE);
+	int r;
+
+	if (!(utf->utf_err & FEC_WR) || !(uvpd[PDX(addr)] & PTE_P)
+	    || (uvpt[PGNUM(addr)] & (PTE_P | PTE_COW)) != (PTE_P | PTE_COW))
+		panic("page fault at va %08x, eip %08x, err %04x",
+		      utf->utf_fault_va, utf->utf_eip, utf->utf_err);
+
+	if ((r = sys_page_alloc(0, PFTEMP, PTE_P | PTE_U | PTE_W)) < 0)
+		panic("mmap_pgfault: sys_page_alloc: %e", r);
+	memmove(PFTEMP, addr, PGSIZE);
+	if ((r = sys_page_map(0, PFTEMP, 0, addr, PTE_P | PTE_U | PTE_W)) < 0)
+		panic("mmap_pgfault: sys_page_map: %e", r);
+	if ((r = sys_page_unmap(0, PFTEMP)) < 0)
+		panic("mmap_pgfault: sys_page_unmap: %e", r);
+}
+
+// Map 'len' bytes of file descriptor 'fdnum', starting at 'offset',
+// at 'addr'.  The mapping shares the file server's cache pages, so
+// writes to the file through write() show up in it for as long as the
+// server keeps those pages cached; once it drops them (for instance on
+// FSREQ_DROP_CACHES) the mapping keeps the old pages.  With MAP_SHARED the
+// pages are read-only; with MAP_PRIVATE they can be written, and
+// those writes go to private copies that never reach the file.
+// A program that maps a file privately must not install a page fault
+// handler of its own.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_INVAL if addr or offset is not page-aligned, the range does
+//		not fit below UTOP, part of it lies past the end of the
+//		file, or the file is open for writing only.
+//	-E_NOT_SUPP if the device cannot map its files.
+int
+mmap(void *addr, size_t len, int flags, int fdnum, off_t offset)
+{
+	struct Dev *dev;
+	struct Fd *fd;
+	size_t i;
+	int r;
+
+	if ((r = fd_lookup(fdnum, &fd)) < 0
+	    || (r = dev_lookup(fd->fd_dev_id, &dev)) < 0)
+		return r;
+	if ((fd->fd_omode & O_ACCMODE) == O_WRONLY)
+		return -E_INVAL;
+	if (!dev->dev_map)
+		return -E_NOT_SUPP;
+	if (PGOFF(addr) || PGOFF(offset) || offset < 0
+	    || (uintptr_t) addr + len > UTOP || (uintptr_t) addr + len < (uintptr_t) addr)
+		return -E_INVAL;
+
+	if (flags & MAP_PRIVATE)
+		set_pgfault_handler(mmap_pgfault);
+
+	for (i = 0; i < len; i += PGSIZE) {
+		if ((r = (*dev->dev_map)(fd, offset + i, addr + i)) < 0)
+			goto fail;
+		if ((flags & MAP_PRIVATE)
+		    && (r = sys_page_map(0, addr + i, 0, addr + i,
+					 PTE_P | PTE_U | PTE_COW)) < 0)
+			goto fail;
+	}
+	return 0;
+
+fail:
+	munmap(addr, i);
+	return r;
+}
+
+// Remove the mappings of the pages covering [addr, addr + len).
+// Returns 0 on success, < 0 on error.
+int
+munmap(void *addr, size_t len)
+{
+	uintptr_t va;
+	int r;
+
+	for (va = ROUNDDOWN((uintptr_t) addr, PGSIZE); va < (uintptr_t) addr + len; va += PGSIZE)
+		if ((r = sys_page_unmap(0, (void *) va)) < 0)
+			return r;
+	return 0;
+}
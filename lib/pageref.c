@@ -0,0 +1,16 @@
+#include <inc/lib.h>
+
+// Return the number of mappings of the physical page backing 'v',
+// or 0 if 'v' is not mapped.
+int
+pageref(void *v)
+{
+	pte_t pte;
+
+	if (!(uvpd[PDX(v)] & PTE_P))
+		return 0;
+	pte = uvpt[PGNUM(v)];
+	if (!(pte & PTE_P))
+		return 0;
+	return pages[PGNUM(pte)].pp_ref;
+}
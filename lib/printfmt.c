@@ -26,6 +26,14 @@ static const char * const error_string[MAXERROR] =
 	[E_NO_MEM]	= "out of memory",
 	[E_NO_FREE_ENV]	= "out of environments",
 	[E_FAULT]	= "segmentation fault",
+	[E_NOT_FOUND]	= "file or program not found",
+	[E_NOT_EXEC]	= "file is not a valid executable",
+	[E_IPC_NOT_RECV]= "env is not recving",
+	[E_NO_DISK]	= "no free space on disk",
+	[E_MAX_OPEN]	= "too many files are open",
+	[E_BAD_PATH]	= "invalid path",
+	[E_FILE_EXISTS]	= "file already exists",
+	[E_NOT_SUPP]	= "operation not supported",
 };
 
 /*
@@ -1,6 +1,7 @@
 // Basic string routines.  Not hardware optimized, but not shabby.
 
 #include <inc/string.h>
+#include <inc/x86.h>
 
 // Using assembly for memset/memmove
 // makes some difference on real hardware,
@@ -8,24 +9,51 @@
 // Primespipe runs 3x faster this way.
 #define ASM 1
 
+// The scanning and comparison routines work a 32-bit word at a time
+// once their pointers are word-aligned, handling the unaligned head and
+// the tail byte-wise.  An aligned word never straddles a page, so reading
+// a whole word that runs past the end of a string is safe.
+//
+// HASZERO(w) is nonzero iff some byte of w is zero: subtracting 1 from
+// each byte borrows into the top bit only for bytes that were 0 (or had
+// the top bit set, which '& ~w' rules out).
+typedef uint32_t __attribute__((may_alias)) word_t;
+
+#define ONES		0x01010101U
+#define HIGHS		0x80808080U
+#define HASZERO(w)	(((w) - ONES) & ~(w) & HIGHS)
+#define ALIGNED(p)	(((uint32_t) (p) & 3) == 0)
+
 int
 strlen(const char *s)
 {
-	int n;
+	const char *start = s;
+	const word_t *w;
 
-	for (n = 0; *s != '\0'; s++)
-		n++;
-	return n;
+	for (; !ALIGNED(s); s++)
+		if (*s == '\0')
+			return s - start;
+	for (w = (const word_t *) s; !HASZERO(*w); w++)
+		/* do nothing */;
+	for (s = (const char *) w; *s != '\0'; s++)
+		/* do nothing */;
+	return s - start;
 }
 
 int
 strnlen(const char *s, size_t size)
 {
-	int n;
-
-	for (n = 0; size > 0 && *s != '\0'; s++, size--)
-		n++;
-	return n;
+	const char *start = s;
+	const word_t *w;
+
+	for (; size > 0 && !ALIGNED(s); s++, size--)
+		if (*s == '\0')
+			return s - start;
+	for (w = (const word_t *) s; size >= 4 && !HASZERO(*w); w++)
+		size -= 4;
+	for (s = (const char *) w; size > 0 && *s != '\0'; s++, size--)
+		/* do nothing */;
+	return s - start;
 }
 
 char *
@@ -76,19 +104,50 @@ strlcpy(char *dst, const char *src, size_t size)
 	return dst - dst_in;
 }
 
+// Strings with different alignments are compared byte-wise: reading
+// both a word at a time would need unaligned loads, which may cross into
+// an unmapped page.
 int
 strcmp(const char *p, const char *q)
 {
+	const word_t *wp, *wq;
+
+	if (((uint32_t) p & 3) == ((uint32_t) q & 3)) {
+		for (; !ALIGNED(p); p++, q++)
+			if (!*p || *p != *q)
+				goto done;
+		wp = (const word_t *) p;
+		wq = (const word_t *) q;
+		while (*wp == *wq && !HASZERO(*wp))
+			wp++, wq++;
+		p = (const char *) wp;
+		q = (const char *) wq;
+	}
 	while (*p && *p == *q)
 		p++, q++;
+done:
 	return (int) ((unsigned char) *p - (unsigned char) *q);
 }
 
 int
 strncmp(const char *p, const char *q, size_t n)
 {
+	const word_t *wp, *wq;
+
+	if (((uint32_t) p & 3) == ((uint32_t) q & 3)) {
+		for (; n > 0 && !ALIGNED(p); n--, p++, q++)
+			if (!*p || *p != *q)
+				goto done;
+		wp = (const word_t *) p;
+		wq = (const word_t *) q;
+		while (n >= 4 && *wp == *wq && !HASZERO(*wp))
+			n -= 4, wp++, wq++;
+		p = (const char *) wp;
+		q = (const char *) wq;
+	}
 	while (n > 0 && *p && *p == *q)
 		n--, p++, q++;
+done:
 	if (n == 0)
 		return 0;
 	else
@@ -100,7 +159,18 @@ strncmp(const char *p, const char *q, size_t n)
 char *
 strchr(const char *s, char c)
 {
-	for (; *s; s++)
+	uint32_t cc = (unsigned char) c * ONES;
+	const word_t *w;
+
+	for (; !ALIGNED(s); s++) {
+		if (!*s)
+			return 0;
+		if (*s == c)
+			return (char *) s;
+	}
+	for (w = (const word_t *) s; !HASZERO(*w) && !HASZERO(*w ^ cc); w++)
+		/* do nothing */;
+	for (s = (const char *) w; *s; s++)
 		if (*s == c)
 			return (char *) s;
 	return 0;
@@ -117,27 +187,131 @@ strfind(const char *s, char c)
 	return (char *) s;
 }
 
+// The ASM versions do the bulk of every copy or fill with 4-byte string
+// instructions, after moving single bytes until the destination is
+// aligned and before the last few tail bytes.  Page-sized fills use
+// non-temporal stores (SSE2 movnti) when the CPU has them, so zeroing a
+// fresh page doesn't evict the working set from the cache.  movnti writes
+// from general registers, so it needs no saved FPU/SSE state and is safe
+// in the kernel.  Nothing here uses XMM registers for that reason.
+
 #if ASM
+#define CPUID_EDX_SSE2	(1 << 26)
+#define NT_MIN		4096	// fills at least this big bypass the cache
+
+// Does the CPU support movnti?  -1 until first checked.
+static int has_movnti = -1;
+
+static int
+movnti_supported(void)
+{
+	uint32_t edx;
+
+	if (has_movnti < 0) {
+		cpuid(1, NULL, NULL, NULL, &edx);
+		has_movnti = (edx & CPUID_EDX_SSE2) != 0;
+	}
+	return has_movnti;
+}
+
+// Fill n/16 16-byte blocks at 4-byte aligned 'p' with word 'c',
+// bypassing the cache.  Returns the address after the last block.
+static char *
+memset_nt(char *p, uint32_t c, size_t n)
+{
+	size_t blocks = n / 16;
+
+	asm volatile("1:	movnti %1, 0(%0)\n"
+		     "	movnti %1, 4(%0)\n"
+		     "	movnti %1, 8(%0)\n"
+		     "	movnti %1, 12(%0)\n"
+		     "	addl $16, %0\n"
+		     "	decl %2\n"
+		     "	jnz 1b\n"
+		     "	sfence\n"
+		     : "+r" (p), "+r" (c), "+r" (blocks)
+		     :: "cc", "memory");
+	return p;
+}
+
 void *
 memset(void *v, int c, size_t n)
 {
-	char *p;
+	char *p = v;
+	size_t cnt;
 
 	if (n == 0)
 		return v;
-	if ((int)v%4 == 0 && n%4 == 0) {
-		c &= 0xFF;
-		c = (c<<24)|(c<<16)|(c<<8)|c;
-		asm volatile("cld; rep stosl\n"
-			:: "D" (v), "a" (c), "c" (n/4)
-			: "cc", "memory");
-	} else
+	c &= 0xFF;
+	c = (c<<24)|(c<<16)|(c<<8)|c;
+	if (n >= 16) {
+		cnt = -(uint32_t) p & 3;
+		n -= cnt;
 		asm volatile("cld; rep stosb\n"
-			:: "D" (v), "a" (c), "c" (n)
-			: "cc", "memory");
+			: "+D" (p), "+c" (cnt) : "a" (c) : "cc", "memory");
+		if (n >= NT_MIN && movnti_supported()) {
+			p = memset_nt(p, c, n);
+			n %= 16;
+		}
+		cnt = n / 4;
+		n %= 4;
+		asm volatile("rep stosl\n"
+			: "+D" (p), "+c" (cnt) : "a" (c) : "cc", "memory");
+	}
+	asm volatile("cld; rep stosb\n"
+		: "+D" (p), "+c" (n) : "a" (c) : "cc", "memory");
 	return v;
 }
 
+// Forward copy: byte head to align the destination, words, byte tail.
+static void
+copy_forward(char *d, const char *s, size_t n)
+{
+	size_t cnt;
+
+	if (n >= 16) {
+		cnt = -(uint32_t) d & 3;
+		n -= cnt;
+		asm volatile("cld; rep movsb\n"
+			: "+D" (d), "+S" (s), "+c" (cnt) :: "cc", "memory");
+		cnt = n / 4;
+		n %= 4;
+		asm volatile("rep movsl\n"
+			: "+D" (d), "+S" (s), "+c" (cnt) :: "cc", "memory");
+	}
+	asm volatile("cld; rep movsb\n"
+		: "+D" (d), "+S" (s), "+c" (n) :: "cc", "memory");
+}
+
+// Backward copy of the n bytes below 'd' from the n bytes below 's':
+// byte tail to align the end of the destination, words, head bytes.
+static void
+copy_backward(char *d, const char *s, size_t n)
+{
+	size_t cnt;
+
+	d--;
+	s--;
+	if (n >= 16) {
+		cnt = ((uint32_t) d + 1) & 3;
+		n -= cnt;
+		asm volatile("std; rep movsb\n"
+			: "+D" (d), "+S" (s), "+c" (cnt) :: "cc", "memory");
+		cnt = n / 4;
+		n %= 4;
+		d -= 3;
+		s -= 3;
+		asm volatile("rep movsl\n"
+			: "+D" (d), "+S" (s), "+c" (cnt) :: "cc", "memory");
+		d += 3;
+		s += 3;
+	}
+	asm volatile("std; rep movsb\n"
+		: "+D" (d), "+S" (s), "+c" (n) :: "cc", "memory");
+	// Some versions of GCC rely on DF being clear
+	asm volatile("cld" ::: "cc");
+}
+
 void *
 memmove(void *dst, const void *src, size_t n)
 {
@@ -146,25 +320,19 @@ memmove(void *dst, const void *src, size_t n)
 
 	s = src;
 	d = dst;
-	if (s < d && s + n > d) {
-		s += n;
-		d += n;
-		if ((int)s%4 == 0 && (int)d%4 == 0 && n%4 == 0)
-			asm volatile("std; rep movsl\n"
-				:: "D" (d-4), "S" (s-4), "c" (n/4) : "cc", "memory");
-		else
-			asm volatile("std; rep movsb\n"
-				:: "D" (d-1), "S" (s-1), "c" (n) : "cc", "memory");
-		// Some versions of GCC rely on DF being clear
-		asm volatile("cld" ::: "cc");
-	} else {
-		if ((int)s%4 == 0 && (int)d%4 == 0 && n%4 == 0)
-			asm volatile("cld; rep movsl\n"
-				:: "D" (d), "S" (s), "c" (n/4) : "cc", "memory");
-		else
-			asm volatile("cld; rep movsb\n"
-				:: "D" (d), "S" (s), "c" (n) : "cc", "memory");
-	}
+	if (s < d && s + n > d)
+		copy_backward(d + n, s + n, n);
+	else
+		copy_forward(d, s, n);
+	return dst;
+}
+
+// memcpy's buffers may not overlap, so it skips memmove's overlap check
+// and always copies forward.
+void *
+memcpy(void *dst, const void *src, size_t n)
+{
+	copy_forward(dst, src, n);
 	return dst;
 }
 
@@ -174,11 +342,16 @@ void *
 memset(void *v, int c, size_t n)
 {
 	char *p;
-	int m;
+	uint32_t w;
 
 	p = v;
-	m = n;
-	while (--m >= 0)
+	c &= 0xFF;
+	w = (c<<24)|(c<<16)|(c<<8)|c;
+	for (; n > 0 && (uint32_t) p % 4; n--)
+		*p++ = c;
+	for (; n >= 4; n -= 4, p += 4)
+		*(uint32_t *) p = w;
+	while (n-- > 0)
 		*p++ = c;
 
 	return v;
@@ -195,27 +368,63 @@ memmove(void *dst, const void *src, size_t n)
 	if (s < d && s + n > d) {
 		s += n;
 		d += n;
+		if ((uint32_t) s % 4 == (uint32_t) d % 4) {
+			for (; n > 0 && (uint32_t) d % 4; n--)
+				*--d = *--s;
+			for (; n >= 4; n -= 4) {
+				d -= 4;
+				s -= 4;
+				*(uint32_t *) d = *(const uint32_t *) s;
+			}
+		}
 		while (n-- > 0)
 			*--d = *--s;
 	} else
-		while (n-- > 0)
-			*d++ = *s++;
+		return memcpy(dst, src, n);
 
 	return dst;
 }
-#endif
 
 void *
 memcpy(void *dst, const void *src, size_t n)
 {
-	return memmove(dst, src, n);
+	const char *s;
+	char *d;
+
+	s = src;
+	d = dst;
+	if ((uint32_t) s % 4 == (uint32_t) d % 4) {
+		for (; n > 0 && (uint32_t) d % 4; n--)
+			*d++ = *s++;
+		for (; n >= 4; n -= 4, d += 4, s += 4)
+			*(uint32_t *) d = *(const uint32_t *) s;
+	}
+	while (n-- > 0)
+		*d++ = *s++;
+
+	return dst;
 }
+#endif
 
 int
 memcmp(const void *v1, const void *v2, size_t n)
 {
 	const uint8_t *s1 = (const uint8_t *) v1;
 	const uint8_t *s2 = (const uint8_t *) v2;
+	const word_t *w1, *w2;
+
+	// Skip equal words; the byte loop below finds the differing byte.
+	if (((uint32_t) s1 & 3) == ((uint32_t) s2 & 3)) {
+		for (; n > 0 && !ALIGNED(s1); n--, s1++, s2++)
+			if (*s1 != *s2)
+				return (int) *s1 - (int) *s2;
+		w1 = (const word_t *) s1;
+		w2 = (const word_t *) s2;
+		while (n >= 4 && *w1 == *w2)
+			n -= 4, w1++, w2++;
+		s1 = (const uint8_t *) w1;
+		s2 = (const uint8_t *) w2;
+	}
 
 	while (n-- > 0) {
 		if (*s1 != *s2)
@@ -230,7 +439,16 @@ void *
 memfind(const void *s, int c, size_t n)
 {
 	const void *ends = (const char *) s + n;
-	for (; s < ends; s++)
+	uint32_t cc = (unsigned char) c * ONES;
+	const word_t *w;
+
+	for (; s < ends && !ALIGNED(s); s++)
+		if (*(const unsigned char *) s == (unsigned char) c)
+			return (void *) s;
+	for (w = s; (const char *) ends - (const char *) w >= 4
+		     && !HASZERO(*w ^ cc); w++)
+		/* do nothing */;
+	for (s = w; s < ends; s++)
 		if (*(const unsigned char *) s == (unsigned char) c)
 			break;
 	return (void *) s;
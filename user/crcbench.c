@@ -0,0 +1,131 @@
+// check lib/crc.c against known vectors and bytewise reference versions,
+// then measure crc32c throughput.  Pass the TSC rate in MHz as argv[1]
+// to also get MB/s.
+#include <inc/lib.h>
+#include <inc/crc.h>
+#include <inc/x86.h>
+
+#define NITER	32
+#define BUFSIZE	(16384 + 8)
+
+static uint8_t buf[BUFSIZE];
+static const size_t lens[] = { 16, 64, 256, 1024, 4096, 16384 };
+
+static uint32_t
+byte_crc32c(uint32_t crc, const void *v, size_t n)
+{
+	const uint8_t *p = v;
+	int i;
+
+	crc = ~crc;
+	for (; n > 0; n--) {
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (crc & 1 ? 0x82f63b78 : 0);
+	}
+	return ~crc;
+}
+
+static uint16_t
+byte_inet_checksum(const void *v, size_t n)
+{
+	const uint8_t *p = v;
+	uint32_t sum = 0;
+
+	for (; n > 1; n -= 2, p += 2)
+		sum += (p[0] << 8) | p[1];
+	if (n)
+		sum += p[0] << 8;
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	sum = ~sum & 0xffff;
+	// back to the byte order it would be stored in
+	return (sum >> 8) | ((sum & 0xff) << 8);
+}
+
+// Run 'expr' NITER times and report the fastest run in cycles.
+#define TIME(var, expr)					\
+	do {						\
+		uint64_t t0, t1;			\
+		int _i;					\
+		var = ~0U;				\
+		for (_i = 0; _i < NITER; _i++) {	\
+			t0 = read_tsc();		\
+			expr;				\
+			t1 = read_tsc();		\
+			if (t1 - t0 < var)		\
+				var = t1 - t0;		\
+		}					\
+	} while (0)
+
+// Print cycles per byte with two decimals, and MB/s if 'mhz' is known.
+static void
+report(const char *name, size_t len, uint32_t cycles, uint32_t mhz)
+{
+	uint32_t cpb = (uint32_t) ((uint64_t) cycles * 100 / len);
+
+	cprintf("%-5s %6d %5d.%02d", name, len, cpb / 100, cpb % 100);
+	if (mhz && cycles)
+		cprintf(" %7u", (uint32_t) ((uint64_t) len * mhz / cycles));
+	cprintf("\n");
+}
+
+void
+umain(int argc, char **argv)
+{
+	volatile uint32_t sink;
+	uint32_t cycles, mhz = 0, crc;
+	int i, align, bad = 0;
+	size_t len, split;
+	bool hw = crc32c_hw_supported();
+
+	if (argc > 1)
+		mhz = strtol(argv[1], 0, 0);
+	for (i = 0; i < BUFSIZE; i++)
+		buf[i] = i * 7 + (i >> 8);
+
+	// Known vectors: RFC 3720 check value, and RFC 1071's example.
+	if (crc32c(0, "123456789", 9) != 0xe3069283
+	    || crc32c_sw(0, "123456789", 9) != 0xe3069283
+	    || (hw && crc32c_hw(0, "123456789", 9) != 0xe3069283))
+		bad++;
+	if (inet_checksum("\x00\x01\xf2\x03\xf4\xf5\xf6\xf7", 8) != 0x0d22)
+		bad++;
+
+	// Every alignment and odd length, and chaining across a split.
+	for (align = 0; align < 8; align++)
+		for (len = 0; len < 64; len++) {
+			crc = byte_crc32c(0, buf + align, len);
+			if (crc32c_sw(0, buf + align, len) != crc
+			    || (hw && crc32c_hw(0, buf + align, len) != crc))
+				bad++;
+			split = len / 3;
+			if (crc32c(crc32c(0, buf + align, split),
+				   buf + align + split, len - split) != crc)
+				bad++;
+			if (inet_checksum(buf + align, len)
+			    != byte_inet_checksum(buf + align, len))
+				bad++;
+		}
+
+	cprintf("sse4.2 crc32: %s\n", hw ? "yes" : "no");
+	cprintf("%-5s %6s %8s%s\n", "func", "len", "cyc/byte",
+		mhz ? "    MB/s" : "");
+	for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+		len = lens[i];
+		if (hw) {
+			TIME(cycles, sink = crc32c_hw(0, buf, len));
+			report("hw", len, cycles, mhz);
+		}
+		TIME(cycles, sink = crc32c_sw(0, buf, len));
+		report("sw", len, cycles, mhz);
+		TIME(cycles, sink = byte_crc32c(0, buf, len));
+		report("byte", len, cycles, mhz);
+		TIME(cycles, sink = inet_checksum(buf, len));
+		report("inet", len, cycles, mhz);
+	}
+
+	if (bad)
+		panic("crcbench: %d results disagree with the reference versions", bad);
+	cprintf("crcbench: all results agree\n");
+}
@@ -0,0 +1,68 @@
+// measure file server disk throughput: write a file through to disk,
+// evict it from the block cache, and read it back.  Pass the TSC rate
+// in MHz as argv[1] to get KB/s as well as cycles per block.
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define NBLOCKS	256		// 1MB
+#define PATH	"/diskbench"
+
+static uint32_t buf[BLKSIZE / 4];
+
+static void
+report(const char *what, uint64_t cycles, uint32_t mhz)
+{
+	cprintf("%-6s %4d blocks %10u cycles/block", what, NBLOCKS,
+		(uint32_t) (cycles / NBLOCKS));
+	if (mhz && cycles)
+		cprintf(" %7u KB/s",
+			(uint32_t) ((uint64_t) NBLOCKS * BLKSIZE / 1024 * mhz * 1000000 / cycles));
+	cprintf("\n");
+}
+
+void
+umain(int argc, char **argv)
+{
+	uint64_t t0, t1;
+	uint32_t mhz = 0;
+	int fd, r, i, j;
+
+	if (argc > 1)
+		mhz = strtol(argv[1], 0, 0);
+
+	if ((fd = open(PATH, O_RDWR | O_CREAT | O_TRUNC)) < 0)
+		panic("open %s: %e", PATH, fd);
+	t0 = read_tsc();
+	for (i = 0; i < NBLOCKS; i++) {
+		for (j = 0; j < BLKSIZE / 4; j++)
+			buf[j] = i * BLKSIZE + j;
+		for (j = 0; j < BLKSIZE; j += r)
+			if ((r = write(fd, (char *) buf + j, BLKSIZE - j)) < 0)
+				panic("write %s: %e", PATH, r);
+	}
+	if ((r = sync()) < 0)
+		panic("sync: %e", r);
+	t1 = read_tsc();
+	close(fd);
+	report("write", t1 - t0, mhz);
+
+	if ((r = drop_caches()) < 0)
+		panic("drop_caches: %e", r);
+	if ((fd = open(PATH, O_RDONLY)) < 0)
+		panic("open %s: %e", PATH, fd);
+	t0 = read_tsc();
+	for (i = 0; i < NBLOCKS; i++) {
+		if ((r = readn(fd, buf, BLKSIZE)) != BLKSIZE)
+			panic("read %s block %d: %e", PATH, i, r);
+		for (j = 0; j < BLKSIZE / 4; j++)
+			if (buf[j] != i * BLKSIZE + j)
+				panic("read %s block %d: wrong data", PATH, i);
+	}
+	t1 = read_tsc();
+	close(fd);
+	report("read", t1 - t0, mhz);
+
+	if ((r = remove(PATH)) < 0)
+		panic("remove %s: %e", PATH, r);
+	cprintf("diskbench: data verified\n");
+}
@@ -0,0 +1,13 @@
+// print the argument count and the arguments themselves
+#include <inc/lib.h>
+
+void
+umain(int argc, char **argv)
+{
+	int i;
+
+	cprintf("argc %d:", argc);
+	for (i = 0; i < argc; i++)
+		cprintf(" %s", argv[i]);
+	cprintf("\n");
+}
@@ -0,0 +1,72 @@
+// run two children that each set a different FPU rounding mode, then
+// yield back and forth; lazy FPU switching must keep the modes apart
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define FPU_RC_SHIFT	10
+#define FPU_RC_DOWN	1
+#define FPU_RC_UP	2
+#define MXCSR_RC_SHIFT	13
+#define CPUID_EDX_SSE	(1 << 25)
+
+static int
+fpu_round(double x)
+{
+	int r;
+
+	asm volatile("fldl %1; fistpl %0" : "=m" (r) : "m" (x));
+	return r;
+}
+
+static void
+child(const char *mode)
+{
+	int rc = strcmp(mode, "down") == 0 ? FPU_RC_DOWN : FPU_RC_UP;
+	int want_pos = rc == FPU_RC_DOWN ? 2 : 3;
+	int want_neg = rc == FPU_RC_DOWN ? -3 : -2;
+	uint32_t edx, mxcsr;
+	uint16_t cw;
+	bool sse;
+	int i;
+
+	cpuid(1, NULL, NULL, NULL, &edx);
+	sse = (edx & CPUID_EDX_SSE) != 0;
+
+	asm volatile("fnstcw %0" : "=m" (cw));
+	cw = (cw & ~(3 << FPU_RC_SHIFT)) | (rc << FPU_RC_SHIFT);
+	asm volatile("fldcw %0" : : "m" (cw));
+	if (sse) {
+		asm volatile("stmxcsr %0" : "=m" (mxcsr));
+		mxcsr = (mxcsr & ~(3 << MXCSR_RC_SHIFT)) | (rc << MXCSR_RC_SHIFT);
+		asm volatile("ldmxcsr %0" : : "m" (mxcsr));
+	}
+
+	for (i = 0; i < 50; i++) {
+		sys_yield();
+		if (fpu_round(2.5) != want_pos || fpu_round(-2.5) != want_neg)
+			panic("rounding %s: got %d and %d after %d yields",
+			      mode, fpu_round(2.5), fpu_round(-2.5), i);
+		if (sse) {
+			asm volatile("stmxcsr %0" : "=m" (mxcsr));
+			if (((mxcsr >> MXCSR_RC_SHIFT) & 3) != rc)
+				panic("rounding %s: mxcsr %x after %d yields",
+				      mode, mxcsr, i);
+		}
+	}
+	cprintf("fputest: rounding %s ok\n", mode);
+}
+
+void
+umain(int argc, char **argv)
+{
+	const char *down[] = { "fputest", "down", NULL };
+	const char *up[] = { "fputest", "up", NULL };
+	envid_t r;
+
+	if (argc == 2) {
+		child(argv[1]);
+		return;
+	}
+	if ((r = sys_spawn("fputest", down)) < 0 || (r = sys_spawn("fputest", up)) < 0)
+		panic("spawn: %e", r);
+}
@@ -0,0 +1,26 @@
+// spawn embedded programs as children, with and without arguments
+#include <inc/lib.h>
+
+void
+umain(int argc, char **argv)
+{
+	const char *args[] = { "echo", "arguments", "made", "it", NULL };
+	envid_t child;
+
+	cprintf("i am parent environment %08x\n", thisenv->env_id);
+	if ((child = sys_spawn("hello", NULL)) < 0)
+		panic("spawn(hello) failed: %e", child);
+	cprintf("spawned hello as %08x\n", child);
+
+	if ((child = sys_spawn("echo", args)) < 0)
+		panic("spawn(echo) failed: %e", child);
+	cprintf("spawned echo as %08x\n", child);
+
+	if ((child = sys_spawn("no-such-program", NULL)) != -E_NOT_FOUND)
+		panic("spawn(no-such-program) returned %e", child);
+	cprintf("spawn of a missing program failed cleanly\n");
+
+	if ((child = sys_spawn((const char *) 1, NULL)) != -E_FAULT)
+		panic("spawn(bad pointer) returned %e", child);
+	cprintf("spawn of a bad pointer failed cleanly\n");
+}
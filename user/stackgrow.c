@@ -0,0 +1,28 @@
+// recurse deep enough to grow the stack well past its first page,
+// then recurse without bound to run into the stack guard page
+#include <inc/lib.h>
+
+#define FRAMESIZE	1024
+
+int
+recurse(int depth, int limit)
+{
+	volatile char frame[FRAMESIZE];
+
+	frame[0] = depth;
+	frame[FRAMESIZE - 1] = depth;
+	if (limit && depth == limit)
+		return frame[0] + frame[FRAMESIZE - 1];
+	return recurse(depth + 1, limit) + frame[0];
+}
+
+void
+umain(int argc, char **argv)
+{
+	// About 200 pages of stack
+	recurse(0, 200 * PGSIZE / FRAMESIZE);
+	cprintf("deep recursion is good\n");
+
+	recurse(0, 0);
+	cprintf("unbounded recursion returned!\n");
+}
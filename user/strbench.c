@@ -0,0 +1,188 @@
+// measure lib/string.c throughput across lengths and alignments,
+// against plain byte-at-a-time loops as a baseline
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define NITER	64
+#define BUFSIZE	(4096 + 8)
+
+static char buf1[BUFSIZE], buf2[BUFSIZE];
+static const size_t lens[] = { 3, 16, 64, 256, 1024, 4096 };
+
+static int
+byte_strlen(const char *s)
+{
+	int n;
+
+	for (n = 0; *s != '\0'; s++)
+		n++;
+	return n;
+}
+
+static int
+byte_strcmp(const char *p, const char *q)
+{
+	while (*p && *p == *q)
+		p++, q++;
+	return (int) ((unsigned char) *p - (unsigned char) *q);
+}
+
+static int
+byte_memcmp(const void *v1, const void *v2, size_t n)
+{
+	const uint8_t *s1 = v1, *s2 = v2;
+
+	for (; n > 0; n--, s1++, s2++)
+		if (*s1 != *s2)
+			return (int) *s1 - (int) *s2;
+	return 0;
+}
+
+static int
+byte_strncmp(const char *p, const char *q, size_t n)
+{
+	while (n > 0 && *p && *p == *q)
+		n--, p++, q++;
+	if (n == 0)
+		return 0;
+	return (int) ((unsigned char) *p - (unsigned char) *q);
+}
+
+static const char *
+byte_strchr(const char *s, char c)
+{
+	for (; *s; s++)
+		if (*s == c)
+			return s;
+	return 0;
+}
+
+// Fill buf1 and buf2 with the same 'len'-character string at offset
+// 'align' (buf2 at 'align2'), followed by a NUL.
+static void
+setup(size_t len, int align, int align2)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		buf1[align + i] = buf2[align2 + i] = 'a' + i % 23;
+	buf1[align + len] = buf2[align2 + len] = '\0';
+}
+
+#define SIGN(x)	(((x) > 0) - ((x) < 0))
+
+// Check results that the timing loop below does not exercise: strings
+// that differ at each position for every pair of alignments, strncmp
+// limits around the difference, strnlen limits, strchr and memfind
+// finding a character at each position, and strchr(s, 0), which
+// finds nothing.  Returns the number of wrong results.
+static int
+check(void)
+{
+	const size_t len = 40;
+	int align, align2, bad = 0;
+	size_t i, n;
+	char *p, *q;
+
+	for (align = 0; align < 4; align++)
+		for (align2 = 0; align2 < 4; align2++)
+			for (i = 0; i <= len; i++) {
+				setup(len, align, align2);
+				p = buf1 + align;
+				q = buf2 + align2;
+				// Below 'a' or, as an unsigned char, above it.
+				q[i] = i % 2 ? 'A' : (char) 0xF0;
+				if (SIGN(strcmp(p, q)) != SIGN(byte_strcmp(p, q))
+				    || SIGN(memcmp(p, q, len + 1))
+				       != SIGN(byte_memcmp(p, q, len + 1)))
+					bad++;
+				for (n = 0; n <= len + 1; n++)
+					if (SIGN(strncmp(p, q, n))
+					    != SIGN(byte_strncmp(p, q, n)))
+						bad++;
+			}
+
+	for (align = 0; align < 4; align++)
+		for (i = 0; i <= len; i++) {
+			setup(i, align, align);
+			p = buf1 + align;
+			for (n = 0; n <= len + 1; n++)
+				if (strnlen(p, n) != MIN(i, n))
+					bad++;
+			if (strchr(p, '\0') != 0)
+				bad++;
+			if (i == len)
+				continue;
+			setup(len, align, align);
+			p[i] = '#';
+			if (strchr(p, '#') != p + i)
+				bad++;
+			for (n = 0; n <= len; n++)
+				if (memfind(p, '#', n) != (i < n ? p + i : p + n))
+					bad++;
+		}
+	return bad;
+}
+
+// Run 'expr' NITER times and report the fastest run in cycles.
+#define TIME(var, expr)					\
+	do {						\
+		uint64_t t0, t1;			\
+		int _i;					\
+		var = ~0U;				\
+		for (_i = 0; _i < NITER; _i++) {	\
+			t0 = read_tsc();		\
+			expr;				\
+			t1 = read_tsc();		\
+			if (t1 - t0 < var)		\
+				var = t1 - t0;		\
+		}					\
+	} while (0)
+
+void
+umain(int argc, char **argv)
+{
+	volatile int sink;
+	uint32_t fast, slow;
+	int i, align, bad;
+	size_t len;
+
+	bad = check();
+	cprintf("%-7s %5s %5s %9s %9s\n", "func", "len", "align", "lib", "bytewise");
+	for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+		len = lens[i];
+		for (align = 0; align < 4; align++) {
+			setup(len, align, align);
+			if (strlen(buf1 + align) != byte_strlen(buf1 + align)
+			    || strcmp(buf1 + align, buf2 + align) != 0
+			    || memcmp(buf1 + align, buf2 + align, len) != 0
+			    || strchr(buf1 + align, '#') != byte_strchr(buf1 + align, '#'))
+				bad++;
+
+			TIME(fast, sink = strlen(buf1 + align));
+			TIME(slow, sink = byte_strlen(buf1 + align));
+			cprintf("%-7s %5d %5d %9u %9u\n", "strlen", len, align, fast, slow);
+			TIME(fast, sink = strcmp(buf1 + align, buf2 + align));
+			TIME(slow, sink = byte_strcmp(buf1 + align, buf2 + align));
+			cprintf("%-7s %5d %5d %9u %9u\n", "strcmp", len, align, fast, slow);
+			TIME(fast, sink = memcmp(buf1 + align, buf2 + align, len));
+			TIME(slow, sink = byte_memcmp(buf1 + align, buf2 + align, len));
+			cprintf("%-7s %5d %5d %9u %9u\n", "memcmp", len, align, fast, slow);
+			TIME(fast, sink = !!strchr(buf1 + align, '#'));
+			TIME(slow, sink = !!byte_strchr(buf1 + align, '#'));
+			cprintf("%-7s %5d %5d %9u %9u\n", "strchr", len, align, fast, slow);
+		}
+
+		// Mismatched alignments take the byte-wise path.
+		setup(len, 0, 1);
+		if (strcmp(buf1, buf2 + 1) != 0)
+			bad++;
+		TIME(fast, sink = strcmp(buf1, buf2 + 1));
+		TIME(slow, sink = byte_strcmp(buf1, buf2 + 1));
+		cprintf("%-7s %5d %5s %9u %9u\n", "strcmp", len, "0/1", fast, slow);
+	}
+
+	if (bad)
+		panic("strbench: %d results disagree with the byte-wise versions", bad);
+	cprintf("strbench: all results agree\n");
+}
@@ -0,0 +1,78 @@
+// exercise the file server through the fd layer: open, stat, read,
+// create, write across indirect blocks, truncate and remove
+#include <inc/lib.h>
+
+static const char *msg = "This is the NEW message of the day!\n\n";
+
+#define NBLOCKS	(NDIRECT + 4)	// enough to need the indirect block
+
+static char buf[BLKSIZE];
+
+void
+umain(int argc, char **argv)
+{
+	struct Stat st;
+	int fd, r, i, j;
+
+	if ((r = open("/not-found", O_RDONLY)) != -E_NOT_FOUND)
+		panic("open /not-found: %e", r);
+	cprintf("open /not-found is good\n");
+
+	if ((fd = open("/newmotd", O_RDONLY)) < 0)
+		panic("open /newmotd: %e", fd);
+	if ((r = fstat(fd, &st)) < 0)
+		panic("fstat /newmotd: %e", r);
+	if (st.st_size != strlen(msg) || st.st_isdir
+	    || strcmp(st.st_name, "newmotd") != 0)
+		panic("fstat /newmotd returned size %d dir %d name %s",
+		      st.st_size, st.st_isdir, st.st_name);
+	cprintf("fstat is good\n");
+
+	memset(buf, 0, sizeof(buf));
+	if ((r = readn(fd, buf, sizeof(buf))) != strlen(msg))
+		panic("read /newmotd returned %d", r);
+	if (strcmp(buf, msg) != 0)
+		panic("read /newmotd returned wrong data");
+	close(fd);
+	cprintf("read is good\n");
+
+	if ((fd = open("/big", O_RDWR | O_CREAT | O_EXCL)) < 0)
+		panic("open /big: %e", fd);
+	for (i = 0; i < NBLOCKS; i++) {
+		for (j = 0; j < BLKSIZE / 4; j++)
+			((uint32_t *) buf)[j] = i * BLKSIZE + j;
+		if ((r = write(fd, buf, BLKSIZE)) < 0)
+			panic("write /big block %d: %e", i, r);
+		// The request page has room for a little less than a block.
+		if ((r = write(fd, buf + r, BLKSIZE - r)) < 0)
+			panic("write /big block %d tail: %e", i, r);
+	}
+	close(fd);
+
+	if ((fd = open("/big", O_RDONLY)) < 0)
+		panic("reopen /big: %e", fd);
+	for (i = 0; i < NBLOCKS; i++) {
+		if ((r = readn(fd, buf, BLKSIZE)) != BLKSIZE)
+			panic("read /big block %d: %e", i, r);
+		for (j = 0; j < BLKSIZE / 4; j++)
+			if (((uint32_t *) buf)[j] != i * BLKSIZE + j)
+				panic("read /big block %d word %d: wrong data", i, j);
+	}
+	close(fd);
+	cprintf("large file is good\n");
+
+	if ((fd = open("/big", O_RDWR | O_TRUNC)) < 0)
+		panic("open /big O_TRUNC: %e", fd);
+	if ((r = fstat(fd, &st)) < 0 || st.st_size != 0)
+		panic("/big not truncated: %e size %d", r, st.st_size);
+	close(fd);
+	if ((r = remove("/")) != -E_INVAL)
+		panic("remove /: %e", r);
+	if ((r = remove("/big")) < 0)
+		panic("remove /big: %e", r);
+	if ((r = open("/big", O_RDONLY)) != -E_NOT_FOUND)
+		panic("open removed /big: %e", r);
+	if ((r = sync()) < 0)
+		panic("sync: %e", r);
+	cprintf("truncate and remove are good\n");
+}
@@ -0,0 +1,59 @@
+// map a file twice, shared and private, and check that the shared
+// mappings are the file server's pages and the private one copies
+#include <inc/lib.h>
+
+static const char *motd = "This is /motd, the message of the day.\n";
+
+#define SHARED1	((char *) 0x40000000)
+#define SHARED2	((char *) 0x40001000)
+#define PRIVATE	((char *) 0x40002000)
+
+static char buf[BLKSIZE];
+
+void
+umain(int argc, char **argv)
+{
+	int fd, n, r;
+
+	if ((fd = open("/motd", O_RDONLY)) < 0)
+		panic("open /motd: %e", fd);
+	if ((n = readn(fd, buf, sizeof(buf))) < strlen(motd))
+		panic("read /motd: %e", n);
+
+	if ((r = mmap(SHARED1, PGSIZE, MAP_SHARED, fd, 0)) < 0)
+		panic("mmap /motd: %e", r);
+	if ((r = mmap(SHARED2, PGSIZE, MAP_SHARED, fd, 0)) < 0)
+		panic("mmap /motd again: %e", r);
+	if (strncmp(SHARED1, motd, strlen(motd)) != 0
+	    || memcmp(SHARED1, buf, n) != 0)
+		panic("mmap /motd returned wrong data");
+	if (PTE_ADDR(uvpt[PGNUM(SHARED1)]) != PTE_ADDR(uvpt[PGNUM(SHARED2)]))
+		panic("mmap /motd twice gave two copies");
+	if (uvpt[PGNUM(SHARED1)] & PTE_W)
+		panic("mmap /motd shared mapping is writable");
+	if (pageref(SHARED1) < 3)
+		panic("mmap /motd page is not the server's cache page");
+	cprintf("mmap shared is good\n");
+
+	if ((r = mmap(PRIVATE, PGSIZE, MAP_PRIVATE, fd, 0)) < 0)
+		panic("mmap /motd private: %e", r);
+	if (PTE_ADDR(uvpt[PGNUM(PRIVATE)]) != PTE_ADDR(uvpt[PGNUM(SHARED1)]))
+		panic("mmap /motd private copied before any write");
+	PRIVATE[0] = 't';
+	if (PTE_ADDR(uvpt[PGNUM(PRIVATE)]) == PTE_ADDR(uvpt[PGNUM(SHARED1)]))
+		panic("mmap /motd private write was not copied");
+	if (PRIVATE[0] != 't' || strncmp(PRIVATE + 1, motd + 1, strlen(motd) - 1) != 0
+	    || SHARED1[0] != 'T')
+		panic("mmap /motd private copy has wrong data");
+	cprintf("mmap private is good\n");
+
+	if ((r = mmap(SHARED1, 2 * PGSIZE, MAP_SHARED, fd, 0)) != -E_INVAL)
+		panic("mmap past end of /motd: %e", r);
+	if (!(uvpt[PGNUM(SHARED2)] & PTE_P)
+	    || strncmp(SHARED2, motd, strlen(motd)) != 0)
+		panic("failed mmap past end of /motd unmapped SHARED2");
+	if ((r = munmap(SHARED1, 3 * PGSIZE)) < 0)
+		panic("munmap: %e", r);
+	close(fd);
+	cprintf("munmap is good\n");
+}